@@ -0,0 +1,120 @@
+#include "alloc_counter.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+// Blocks are prefixed with their size, padded to keep the alignment.
+constexpr size_t header_size = alignof(std::max_align_t) > sizeof(size_t)
+		? alignof(std::max_align_t)
+		: sizeof(size_t);
+
+std::atomic<size_t> current_bytes{ 0 };
+std::atomic<size_t> peak_bytes{ 0 };
+std::atomic<size_t> reset_bytes{ 0 };
+std::atomic<size_t> num_allocs{ 0 };
+std::atomic<size_t> num_reallocs{ 0 };
+
+// The last allocated block, and whether the last operation allocated it.
+std::atomic<void*> last_alloc{ nullptr };
+std::atomic<bool> last_was_alloc{ false };
+
+void* counted_alloc(size_t size) {
+	void* block = std::malloc(header_size + size);
+	if (block == nullptr) {
+		return nullptr;
+	}
+	*static_cast<size_t*>(block) = size;
+	void* ret = static_cast<char*>(block) + header_size;
+
+	size_t bytes = current_bytes.fetch_add(size, std::memory_order_relaxed)
+			+ size;
+	size_t peak = peak_bytes.load(std::memory_order_relaxed);
+	while (bytes > peak
+			&& !peak_bytes.compare_exchange_weak(
+					peak, bytes, std::memory_order_relaxed)) {
+	}
+
+	num_allocs.fetch_add(1, std::memory_order_relaxed);
+	last_alloc.store(ret, std::memory_order_relaxed);
+	last_was_alloc.store(true, std::memory_order_relaxed);
+	return ret;
+}
+
+void counted_free(void* ptr) {
+	if (ptr == nullptr) {
+		return;
+	}
+
+	if (last_was_alloc.exchange(false, std::memory_order_relaxed)
+			&& last_alloc.load(std::memory_order_relaxed) != ptr) {
+		num_reallocs.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void* block = static_cast<char*>(ptr) - header_size;
+	current_bytes.fetch_sub(
+			*static_cast<size_t*>(block), std::memory_order_relaxed);
+	std::free(block);
+}
+
+void* throwing_alloc(size_t size) {
+	void* ret = counted_alloc(size == 0 ? 1 : size);
+	if (ret == nullptr) {
+		throw std::bad_alloc{};
+	}
+	return ret;
+}
+} // namespace
+
+namespace bench {
+void reset_alloc_stats() {
+	size_t bytes = current_bytes.load(std::memory_order_relaxed);
+	reset_bytes.store(bytes, std::memory_order_relaxed);
+	peak_bytes.store(bytes, std::memory_order_relaxed);
+	num_allocs.store(0, std::memory_order_relaxed);
+	num_reallocs.store(0, std::memory_order_relaxed);
+	last_was_alloc.store(false, std::memory_order_relaxed);
+}
+
+alloc_stats get_alloc_stats() {
+	alloc_stats ret;
+	ret.peak_bytes = peak_bytes.load(std::memory_order_relaxed)
+			- reset_bytes.load(std::memory_order_relaxed);
+	ret.num_allocs = num_allocs.load(std::memory_order_relaxed);
+	ret.num_reallocs = num_reallocs.load(std::memory_order_relaxed);
+	return ret;
+}
+} // namespace bench
+
+void* operator new(size_t size) {
+	return throwing_alloc(size);
+}
+void* operator new[](size_t size) {
+	return throwing_alloc(size);
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+	return counted_alloc(size == 0 ? 1 : size);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+	return counted_alloc(size == 0 ? 1 : size);
+}
+
+void operator delete(void* ptr) noexcept {
+	counted_free(ptr);
+}
+void operator delete[](void* ptr) noexcept {
+	counted_free(ptr);
+}
+void operator delete(void* ptr, size_t) noexcept {
+	counted_free(ptr);
+}
+void operator delete[](void* ptr, size_t) noexcept {
+	counted_free(ptr);
+}
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+	counted_free(ptr);
+}
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+	counted_free(ptr);
+}
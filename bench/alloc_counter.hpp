@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+
+// Heap statistics, gathered by the global operator new and delete replaced in
+// alloc_counter.cpp.
+namespace bench {
+struct alloc_stats {
+	// Highest heap usage since the reset, above the usage at reset.
+	size_t peak_bytes = 0;
+	// Calls to operator new.
+	size_t num_allocs = 0;
+	// Allocations immediately followed by freeing an older block, the pattern
+	// of a growing container.
+	size_t num_reallocs = 0;
+};
+
+// Starts a new measure.
+void reset_alloc_stats();
+
+// Returns the statistics since the last reset.
+alloc_stats get_alloc_stats();
+} // namespace bench
@@ -0,0 +1,548 @@
+#include "alloc_counter.hpp"
+
+#include <fea_flat_recurse/complete_tree.hpp>
+#include <fea_flat_recurse/fea_flat_recurse.hpp>
+#include <fea_flat_recurse/flat_tree.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Standalone traversal benchmark.
+// Sweeps depth x width x node type x algorithm, prints a table and
+// optionally writes json and csv results. Compares against a baseline json
+// and fails if any median or peak heap usage regressed by more than the
+// threshold.
+// Memory is measured on a separate run, starting with empty buffers, so it
+// includes the algorithm's allocations.
+//
+// fea_flat_recurse_bench --depths 4,8,16 --widths 2,8 --json out.json
+// fea_flat_recurse_bench --baseline out.json --threshold 0.05
+
+namespace {
+struct vector_node {
+	vector_node* begin() {
+		return children.data();
+	}
+	vector_node* end() {
+		return children.data() + children.size();
+	}
+
+	std::vector<vector_node> children;
+};
+
+struct list_node {
+	using iter = std::list<list_node>::iterator;
+
+	iter begin() {
+		return children.begin();
+	}
+	iter end() {
+		return children.end();
+	}
+
+	std::list<list_node> children;
+};
+
+template <class Node>
+void build(Node* node, size_t depth, size_t width) {
+	if (depth <= 1) {
+		return;
+	}
+
+	node->children.resize(width);
+	for (Node& child : node->children) {
+		build(&child, depth - 1, width);
+	}
+}
+
+void build(fea::flat_tree<int>* tree, uint32_t node, size_t depth,
+		size_t width) {
+	if (depth <= 1) {
+		return;
+	}
+
+	for (size_t i = 0; i < width; ++i) {
+		build(tree, tree->insert(node, 0), depth - 1, width);
+	}
+}
+
+// Number of nodes in a full tree, saturates at max.
+size_t node_count(size_t depth, size_t width, size_t max) {
+	size_t ret = 0;
+	size_t breadth = 1;
+	for (size_t i = 0; i < depth; ++i) {
+		ret += breadth;
+		if (ret > max || (width != 0 && breadth > max / width)) {
+			return max + 1;
+		}
+		breadth *= width;
+	}
+	return ret;
+}
+
+struct options {
+	std::vector<size_t> depths{ 4, 8, 16 };
+	std::vector<size_t> widths{ 2, 8, 32 };
+	std::vector<std::string> nodes{ "vector", "list", "flat_tree",
+		"complete" };
+	std::vector<std::string> algorithms;
+	size_t repeat = 5;
+	size_t max_nodes = 10'000'000;
+	std::string json_path;
+	std::string csv_path;
+	std::string baseline_path;
+	double threshold = 0.1;
+};
+
+struct result {
+	std::string node;
+	std::string algorithm;
+	size_t depth = 0;
+	size_t width = 0;
+	size_t num_nodes = 0;
+	double min_ns = 0.0;
+	double median_ns = 0.0;
+	size_t peak_bytes = 0;
+	size_t num_allocs = 0;
+	size_t num_reallocs = 0;
+	// False for baselines written before memory was measured.
+	bool has_memory = true;
+
+	std::string key() const {
+		return node + "/" + algorithm + "/" + std::to_string(depth) + "/"
+				+ std::to_string(width);
+	}
+};
+
+struct algorithm {
+	const char* name;
+	std::function<size_t()> run;
+};
+
+// The algorithms to benchmark, on one tree. Returned closures return the
+// number of visited nodes, so the work can't be optimized out.
+template <class It, class StatePtr>
+std::vector<algorithm> make_algorithms(It root, StatePtr* state,
+		std::vector<It>* buf, std::vector<std::vector<It>>* staged_buf) {
+	return {
+		{ "for_each_depthfirst",
+				[=]() {
+					size_t ret = 0;
+					fea::for_each_depthfirst(
+							root, [&](It) { ++ret; }, state);
+					return ret;
+				} },
+		{ "for_each_depthfirst_flat",
+				[=]() {
+					size_t ret = 0;
+					fea::for_each_depthfirst_flat(
+							root, [&](It) { ++ret; }, state);
+					return ret;
+				} },
+		{ "for_each_depthfirst_hybrid",
+				[=]() {
+					size_t ret = 0;
+					fea::for_each_depthfirst_hybrid(
+							root, [&](It) { ++ret; }, state);
+					return ret;
+				} },
+		{ "for_each_breadthfirst",
+				[=]() {
+					size_t ret = 0;
+					fea::for_each_breadthfirst(
+							root, [&](It) { ++ret; }, state);
+					return ret;
+				} },
+		{ "gather_depthfirst",
+				[=]() {
+					fea::gather_depthfirst(root, buf, state);
+					return buf->size();
+				} },
+		{ "gather_depthfirst_flat",
+				[=]() {
+					fea::gather_depthfirst_flat(root, buf, state);
+					return buf->size();
+				} },
+		{ "gather_breadthfirst",
+				[=]() {
+					fea::gather_breadthfirst(root, buf, state);
+					return buf->size();
+				} },
+		{ "gather_breadthfirst_staged",
+				[=]() {
+					fea::gather_breadthfirst_staged(root, staged_buf, state);
+					size_t ret = 0;
+					for (const std::vector<It>& v : *staged_buf) {
+						ret += v.size();
+					}
+					return ret;
+				} },
+	};
+}
+
+bool selected(const std::vector<std::string>& names, const char* name) {
+	return names.empty()
+			|| std::find(names.begin(), names.end(), name) != names.end();
+}
+
+template <class It, class StatePtr>
+void bench_tree(const options& opts, const char* node, size_t depth,
+		size_t width, size_t num_nodes, It root, StatePtr* state,
+		std::vector<result>* out) {
+	std::vector<It> buf;
+	std::vector<std::vector<It>> staged_buf;
+
+	for (const algorithm& algo :
+			make_algorithms(root, state, &buf, &staged_buf)) {
+		if (!selected(opts.algorithms, algo.name)) {
+			continue;
+		}
+
+		// Measure memory from empty buffers.
+		std::vector<It>().swap(buf);
+		std::vector<std::vector<It>>().swap(staged_buf);
+		bench::reset_alloc_stats();
+		size_t num_visited = algo.run();
+		bench::alloc_stats stats = bench::get_alloc_stats();
+
+		if (num_visited != num_nodes) {
+			std::fprintf(stderr, "%s on %s visited the wrong node count\n",
+					algo.name, node);
+			std::exit(EXIT_FAILURE);
+		}
+
+		std::vector<double> times;
+		for (size_t i = 0; i < opts.repeat; ++i) {
+			auto start = std::chrono::steady_clock::now();
+			algo.run();
+			auto end = std::chrono::steady_clock::now();
+			times.push_back(
+					std::chrono::duration<double, std::nano>(end - start)
+							.count());
+		}
+		std::sort(times.begin(), times.end());
+
+		result res;
+		res.node = node;
+		res.algorithm = algo.name;
+		res.depth = depth;
+		res.width = width;
+		res.num_nodes = num_nodes;
+		res.min_ns = times.front();
+		res.median_ns = times[times.size() / 2];
+		res.peak_bytes = stats.peak_bytes;
+		res.num_allocs = stats.num_allocs;
+		res.num_reallocs = stats.num_reallocs;
+
+		std::printf("%-10s %-28s %6zu %6zu %10zu %14.0f %10.2f %12zu %8zu "
+					"%8zu\n",
+				node, algo.name, depth, width, num_nodes, res.median_ns,
+				res.median_ns / double(num_nodes), res.peak_bytes,
+				res.num_allocs, res.num_reallocs);
+		std::fflush(stdout);
+		out->push_back(res);
+	}
+}
+
+void run(const options& opts, std::vector<result>* out) {
+	std::printf("%-10s %-28s %6s %6s %10s %14s %10s %12s %8s %8s\n", "node",
+			"algorithm", "depth", "width", "nodes", "median ns", "ns/node",
+			"peak bytes", "allocs", "reallocs");
+
+	for (size_t depth : opts.depths) {
+		for (size_t width : opts.widths) {
+			size_t num_nodes = node_count(depth, width, opts.max_nodes);
+			if (depth == 0 || num_nodes > opts.max_nodes) {
+				std::printf("skipping depth %zu, width %zu : over %zu nodes\n",
+						depth, width, opts.max_nodes);
+				continue;
+			}
+
+			if (selected(opts.nodes, "vector")) {
+				vector_node root;
+				build(&root, depth, width);
+				bench_tree(opts, "vector", depth, width, num_nodes, &root,
+						static_cast<const void*>(nullptr), out);
+			}
+
+			if (selected(opts.nodes, "list")) {
+				std::list<list_node> roots(1);
+				build(&roots.front(), depth, width);
+				bench_tree(opts, "list", depth, width, num_nodes,
+						roots.begin(), static_cast<const void*>(nullptr),
+						out);
+			}
+
+			if (selected(opts.nodes, "flat_tree")) {
+				fea::flat_tree<int> tree;
+				tree.reserve(num_nodes);
+				build(&tree, tree.insert_root(0), depth, width);
+				bench_tree(opts, "flat_tree", depth, width, num_nodes,
+						tree.root(), static_cast<const void*>(nullptr), out);
+			}
+
+			if (selected(opts.nodes, "complete")) {
+				fea::complete_tree tree{ uint32_t(width),
+					uint32_t(num_nodes) };
+				bench_tree(opts, "complete", depth, width, num_nodes,
+						tree.root(), static_cast<const void*>(nullptr), out);
+			}
+		}
+	}
+}
+
+void write_json(const std::string& path, const std::vector<result>& results) {
+	std::ofstream ofs{ path };
+	ofs << "{\n\t\"results\": [\n";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const result& r = results[i];
+		ofs << "\t\t{ \"node\": \"" << r.node << "\", \"algorithm\": \""
+			<< r.algorithm << "\", \"depth\": " << r.depth
+			<< ", \"width\": " << r.width << ", \"nodes\": " << r.num_nodes
+			<< ", \"min_ns\": " << r.min_ns
+			<< ", \"median_ns\": " << r.median_ns
+			<< ", \"peak_bytes\": " << r.peak_bytes
+			<< ", \"allocs\": " << r.num_allocs
+			<< ", \"reallocs\": " << r.num_reallocs << " }"
+			<< (i + 1 == results.size() ? "\n" : ",\n");
+	}
+	ofs << "\t]\n}\n";
+}
+
+void write_csv(const std::string& path, const std::vector<result>& results) {
+	std::ofstream ofs{ path };
+	ofs << "node,algorithm,depth,width,nodes,min_ns,median_ns,peak_bytes,"
+		   "allocs,reallocs\n";
+	for (const result& r : results) {
+		ofs << r.node << ',' << r.algorithm << ',' << r.depth << ','
+			<< r.width << ',' << r.num_nodes << ',' << r.min_ns << ','
+			<< r.median_ns << ',' << r.peak_bytes << ',' << r.num_allocs
+			<< ',' << r.num_reallocs << '\n';
+	}
+}
+
+// Reads results written by write_json. Only supports flat objects of string
+// and number values.
+bool read_json(const std::string& path, std::vector<result>* out) {
+	std::ifstream ifs{ path };
+	if (!ifs.is_open()) {
+		return false;
+	}
+	std::stringstream ss;
+	ss << ifs.rdbuf();
+	const std::string json = ss.str();
+
+	for (size_t beg = json.find('{', 1); beg != std::string::npos;
+			beg = json.find('{', beg + 1)) {
+		size_t end = json.find('}', beg);
+		if (end == std::string::npos) {
+			break;
+		}
+
+		std::map<std::string, std::string> values;
+		size_t pos = beg;
+		while (true) {
+			size_t key_beg = json.find('"', pos);
+			if (key_beg == std::string::npos || key_beg > end) {
+				break;
+			}
+			size_t key_end = json.find('"', key_beg + 1);
+			size_t val_beg
+					= json.find_first_not_of(" \t\n:", key_end + 1);
+			size_t val_end = json[val_beg] == '"'
+					? json.find('"', val_beg + 1) + 1
+					: json.find_first_of(",} \t\n", val_beg);
+
+			std::string val = json.substr(val_beg, val_end - val_beg);
+			if (!val.empty() && val.front() == '"') {
+				val = val.substr(1, val.size() - 2);
+			}
+			values[json.substr(key_beg + 1, key_end - key_beg - 1)] = val;
+			pos = val_end;
+		}
+
+		result r;
+		r.node = values["node"];
+		r.algorithm = values["algorithm"];
+		r.depth = size_t(std::strtoull(values["depth"].c_str(), nullptr, 10));
+		r.width = size_t(std::strtoull(values["width"].c_str(), nullptr, 10));
+		r.num_nodes
+				= size_t(std::strtoull(values["nodes"].c_str(), nullptr, 10));
+		r.min_ns = std::strtod(values["min_ns"].c_str(), nullptr);
+		r.median_ns = std::strtod(values["median_ns"].c_str(), nullptr);
+		r.has_memory = values.count("peak_bytes") != 0;
+		r.peak_bytes = size_t(
+				std::strtoull(values["peak_bytes"].c_str(), nullptr, 10));
+		r.num_allocs
+				= size_t(std::strtoull(values["allocs"].c_str(), nullptr, 10));
+		r.num_reallocs = size_t(
+				std::strtoull(values["reallocs"].c_str(), nullptr, 10));
+		out->push_back(r);
+		beg = end;
+	}
+	return true;
+}
+
+// Returns the number of regressions.
+size_t compare(const std::vector<result>& baseline,
+		const std::vector<result>& results, double threshold) {
+	std::map<std::string, const result*> baseline_map;
+	for (const result& r : baseline) {
+		baseline_map[r.key()] = &r;
+	}
+
+	std::printf("\ncomparing against baseline, threshold %.1f%%\n",
+			threshold * 100.0);
+
+	size_t num_regressions = 0;
+	for (const result& r : results) {
+		auto it = baseline_map.find(r.key());
+		if (it == baseline_map.end() || it->second->median_ns <= 0.0) {
+			continue;
+		}
+
+		double ratio = r.median_ns / it->second->median_ns;
+		bool regressed = ratio > 1.0 + threshold;
+
+		// Older baselines may not have memory. A baseline which didn't
+		// allocate regresses as soon as anything is allocated.
+		const result& base = *it->second;
+		char mem_change[32] = "n/a";
+		bool mem_regressed = false;
+		if (base.has_memory && base.peak_bytes == 0) {
+			mem_regressed = r.peak_bytes != 0;
+			std::snprintf(mem_change, sizeof(mem_change), "+%zuB",
+					r.peak_bytes);
+		} else if (base.has_memory) {
+			double mem_ratio = double(r.peak_bytes) / double(base.peak_bytes);
+			mem_regressed = mem_ratio > 1.0 + threshold;
+			std::snprintf(mem_change, sizeof(mem_change), "%+.1f%%",
+					(mem_ratio - 1.0) * 100.0);
+		}
+
+		num_regressions += (regressed || mem_regressed) ? 1 : 0;
+		std::printf("%-10s %-28s %6zu %6zu time %+8.1f%% memory %9s%s%s\n",
+				r.node.c_str(), r.algorithm.c_str(), r.depth, r.width,
+				(ratio - 1.0) * 100.0, mem_change,
+				regressed ? "  REGRESSION" : "",
+				mem_regressed ? "  MEMORY REGRESSION" : "");
+	}
+	return num_regressions;
+}
+
+std::vector<std::string> split(const std::string& str) {
+	std::vector<std::string> ret;
+	std::stringstream ss{ str };
+	std::string item;
+	while (std::getline(ss, item, ',')) {
+		if (!item.empty()) {
+			ret.push_back(item);
+		}
+	}
+	return ret;
+}
+
+std::vector<size_t> split_sizes(const std::string& str) {
+	std::vector<size_t> ret;
+	for (const std::string& s : split(str)) {
+		ret.push_back(size_t(std::strtoull(s.c_str(), nullptr, 10)));
+	}
+	return ret;
+}
+
+void print_help() {
+	std::printf(
+			"fea_flat_recurse_bench [options]\n"
+			"  --depths 4,8,16        Tree depths, root included.\n"
+			"  --widths 2,8,32        Children per node.\n"
+			"  --nodes a,b            vector, list, flat_tree, complete\n"
+			"                         (default all).\n"
+			"  --algorithms a,b       Algorithm names (default all).\n"
+			"  --repeat 5             Timed runs per measure.\n"
+			"  --max-nodes 10000000   Skip larger trees.\n"
+			"  --json path            Write json results.\n"
+			"  --csv path             Write csv results.\n"
+			"  --baseline path        Compare to json results.\n"
+			"  --threshold 0.1        Allowed median slowdown and peak heap\n"
+			"                         growth ratio.\n");
+}
+
+bool parse(int argc, char** argv, options* opts) {
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--help" || arg == "-h" || i + 1 >= argc) {
+			return false;
+		}
+
+		std::string val = argv[++i];
+		if (arg == "--depths") {
+			opts->depths = split_sizes(val);
+		} else if (arg == "--widths") {
+			opts->widths = split_sizes(val);
+		} else if (arg == "--nodes") {
+			opts->nodes = split(val);
+		} else if (arg == "--algorithms") {
+			opts->algorithms = split(val);
+		} else if (arg == "--repeat") {
+			opts->repeat = (std::max)(
+					size_t(std::strtoull(val.c_str(), nullptr, 10)),
+					size_t(1));
+		} else if (arg == "--max-nodes") {
+			opts->max_nodes = size_t(std::strtoull(val.c_str(), nullptr, 10));
+		} else if (arg == "--json") {
+			opts->json_path = val;
+		} else if (arg == "--csv") {
+			opts->csv_path = val;
+		} else if (arg == "--baseline") {
+			opts->baseline_path = val;
+		} else if (arg == "--threshold") {
+			opts->threshold = std::strtod(val.c_str(), nullptr);
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+} // namespace
+
+int main(int argc, char** argv) {
+	options opts;
+	if (!parse(argc, argv, &opts)) {
+		print_help();
+		return EXIT_FAILURE;
+	}
+
+	// Read the baseline first, it may be overwritten by the results.
+	std::vector<result> baseline;
+	if (!opts.baseline_path.empty()
+			&& !read_json(opts.baseline_path, &baseline)) {
+		std::fprintf(stderr, "couldn't read baseline '%s'\n",
+				opts.baseline_path.c_str());
+		return EXIT_FAILURE;
+	}
+
+	std::vector<result> results;
+	run(opts, &results);
+
+	if (!opts.json_path.empty()) {
+		write_json(opts.json_path, results);
+	}
+	if (!opts.csv_path.empty()) {
+		write_csv(opts.csv_path, results);
+	}
+
+	if (!opts.baseline_path.empty()
+			&& compare(baseline, results, opts.threshold) != 0) {
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,288 @@
+#pragma once
+/*
+BSD 3-Clause License
+
+Copyright (c) 2019, Philippe Groarke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "fea_flat_recurse.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace fea {
+/*
+ Complete Tree
+*/
+
+// An implicit complete k-ary tree, stored in breadth-first (heap) order.
+// Node i's children are k * i + 1 to k * i + k, no children are stored.
+// Every level is full, except the last which is filled left to right.
+
+// Dereferences to the node index. Iterators carry the tree's arity and size,
+// children are computed arithmetically. No state pointer is required.
+struct complete_tree_iterator {
+	using value_type = uint32_t;
+	using pointer = const uint32_t*;
+	using reference = const uint32_t&;
+	using iterator_category = std::random_access_iterator_tag;
+	using difference_type = std::ptrdiff_t;
+
+	complete_tree_iterator() = default;
+	complete_tree_iterator(uint32_t idx, uint32_t arity, uint32_t size)
+			: _idx(idx)
+			, _arity(arity)
+			, _size(size) {
+	}
+
+	reference operator*() const {
+		return _idx;
+	}
+	pointer operator->() const {
+		return &_idx;
+	}
+	value_type operator[](difference_type n) const {
+		return uint32_t(_idx + n);
+	}
+
+	complete_tree_iterator& operator++() {
+		++_idx;
+		return *this;
+	}
+	complete_tree_iterator operator++(int) {
+		complete_tree_iterator ret = *this;
+		++*this;
+		return ret;
+	}
+	complete_tree_iterator& operator--() {
+		--_idx;
+		return *this;
+	}
+	complete_tree_iterator operator--(int) {
+		complete_tree_iterator ret = *this;
+		--*this;
+		return ret;
+	}
+
+	complete_tree_iterator& operator+=(difference_type n) {
+		_idx = uint32_t(_idx + n);
+		return *this;
+	}
+	complete_tree_iterator& operator-=(difference_type n) {
+		_idx = uint32_t(_idx - n);
+		return *this;
+	}
+	complete_tree_iterator operator+(difference_type n) const {
+		complete_tree_iterator ret = *this;
+		return ret += n;
+	}
+	friend complete_tree_iterator operator+(
+			difference_type n, const complete_tree_iterator& it) {
+		return it + n;
+	}
+	complete_tree_iterator operator-(difference_type n) const {
+		complete_tree_iterator ret = *this;
+		return ret -= n;
+	}
+	difference_type operator-(const complete_tree_iterator& other) const {
+		return difference_type(_idx) - difference_type(other._idx);
+	}
+
+	bool operator==(const complete_tree_iterator& other) const {
+		return _idx == other._idx;
+	}
+	bool operator!=(const complete_tree_iterator& other) const {
+		return !(*this == other);
+	}
+	bool operator<(const complete_tree_iterator& other) const {
+		return _idx < other._idx;
+	}
+	bool operator>(const complete_tree_iterator& other) const {
+		return other < *this;
+	}
+	bool operator<=(const complete_tree_iterator& other) const {
+		return !(other < *this);
+	}
+	bool operator>=(const complete_tree_iterator& other) const {
+		return !(*this < other);
+	}
+
+	// The node index.
+	uint32_t index() const {
+		return _idx;
+	}
+	uint32_t arity() const {
+		return _arity;
+	}
+	// The tree's node count.
+	uint32_t size() const {
+		return _size;
+	}
+
+private:
+	uint32_t _idx = 0;
+	uint32_t _arity = 1;
+	uint32_t _size = 0;
+};
+
+// Describes a complete tree of size nodes, each node has up to arity
+// children. Use root() or node() to start a traversal.
+struct complete_tree {
+	complete_tree(uint32_t arity, uint32_t size)
+			: _arity(arity)
+			, _size(size) {
+		assert(arity != 0);
+	}
+
+	// Iterator to the root, pass it to the apis. The tree must not be empty.
+	complete_tree_iterator root() const {
+		assert(!empty());
+		return node(0);
+	}
+
+	complete_tree_iterator node(uint32_t idx) const {
+		assert(idx < _size);
+		return { idx, _arity, _size };
+	}
+
+	uint32_t arity() const {
+		return _arity;
+	}
+	size_t size() const {
+		return _size;
+	}
+	bool empty() const {
+		return _size == 0;
+	}
+
+	// The root has no parent.
+	uint32_t parent(uint32_t idx) const {
+		assert(idx != 0);
+		return (idx - 1) / _arity;
+	}
+
+	// The index ranges [first, last) of idx's sub-tree, one per level.
+	// Breadth-first order is index order, every level of a sub-tree is
+	// contiguous. Computed in O(depth).
+	void subtree_levels(uint32_t idx,
+			std::vector<std::pair<uint32_t, uint32_t>>* out) const {
+		out->clear();
+		uint64_t first = idx;
+		uint64_t last = uint64_t(idx) + 1;
+		while (first < _size) {
+			last = (std::min)(last, uint64_t(_size));
+			out->push_back({ uint32_t(first), uint32_t(last) });
+			first = first * _arity + 1;
+			last = last * _arity + 1;
+		}
+	}
+
+	// The index ranges [first, last) of every level.
+	void levels(std::vector<std::pair<uint32_t, uint32_t>>* out) const {
+		if (empty()) {
+			out->clear();
+			return;
+		}
+		subtree_levels(0, out);
+	}
+
+private:
+	uint32_t _arity;
+	uint32_t _size;
+};
+
+// Found through ADL.
+template <class StatePtr>
+inline std::pair<complete_tree_iterator, complete_tree_iterator>
+children_range(complete_tree_iterator parent, StatePtr*) {
+	uint64_t first = uint64_t(parent.index()) * parent.arity() + 1;
+	uint64_t last = first + parent.arity();
+	first = (std::min)(first, uint64_t(parent.size()));
+	last = (std::min)(last, uint64_t(parent.size()));
+	return { { uint32_t(first), parent.arity(), parent.size() },
+		{ uint32_t(last), parent.arity(), parent.size() } };
+}
+
+// Found through ADL.
+template <class StatePtr>
+inline complete_tree_iterator parent_node(
+		complete_tree_iterator node, StatePtr*) {
+	return { (node.index() - 1) / node.arity(), node.arity(), node.size() };
+}
+
+// Gathers a breadth-first flat vector, without visiting children.
+// Every level is an index range.
+// Starts at the provided node.
+template <class StatePtr = const void>
+inline void gather_breadthfirst(complete_tree_iterator root,
+		std::vector<complete_tree_iterator>* out, StatePtr* = nullptr) {
+	complete_tree tree{ root.arity(), root.size() };
+	std::vector<std::pair<uint32_t, uint32_t>> levels;
+	tree.subtree_levels(root.index(), &levels);
+
+	size_t count = 0;
+	for (const std::pair<uint32_t, uint32_t>& l : levels) {
+		count += l.second - l.first;
+	}
+
+	out->clear();
+	out->reserve(count);
+	for (const std::pair<uint32_t, uint32_t>& l : levels) {
+		for (uint32_t i = l.first; i < l.second; ++i) {
+			out->push_back({ i, root.arity(), root.size() });
+		}
+	}
+}
+
+// Gathers a breadth-first vector of vector, without visiting children.
+// Sub vectors are the breadths, every breadth is an index range.
+// Starts at the provided node.
+template <class StatePtr = const void>
+inline void gather_breadthfirst_staged(complete_tree_iterator root,
+		std::vector<std::vector<complete_tree_iterator>>* out,
+		StatePtr* = nullptr) {
+	complete_tree tree{ root.arity(), root.size() };
+	std::vector<std::pair<uint32_t, uint32_t>> levels;
+	tree.subtree_levels(root.index(), &levels);
+
+	out->resize(levels.size());
+	for (size_t l = 0; l < levels.size(); ++l) {
+		std::vector<complete_tree_iterator>& breadth = (*out)[l];
+		breadth.clear();
+		breadth.reserve(levels[l].second - levels[l].first);
+		for (uint32_t i = levels[l].first; i < levels[l].second; ++i) {
+			breadth.push_back({ i, root.arity(), root.size() });
+		}
+	}
+}
+} // namespace fea
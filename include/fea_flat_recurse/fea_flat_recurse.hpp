@@ -30,13 +30,36 @@ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
 OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <functional>
 #include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <type_traits>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Keeps cold paths out of hot loops.
+#if defined(_MSC_VER)
+#define FEA_FLAT_RECURSE_NOINLINE __declspec(noinline)
+#else
+#define FEA_FLAT_RECURSE_NOINLINE __attribute__((noinline))
+#endif
+
 namespace fea {
 /*
  Read the following.
@@ -51,6 +74,171 @@ inline std::pair<InputIt, InputIt> children_range(InputIt parent, StatePtr*) {
 	return { parent->begin(), parent->end() };
 }
 
+// Specialize parent_node, or provide parent() on your node, to use the
+// stackless apis. Must return an iterator which compares equal to the one used
+// to reach the parent. The parent of the traversal root is never queried.
+template <class FwdIt, class StatePtr = const void>
+inline FwdIt parent_node(FwdIt node, StatePtr*) {
+	return node->parent();
+}
+
+// Specialize next_siblings_range to customize how the stackless apis find the
+// siblings that follow node. Returns [next sibling, end of siblings).
+// The default uses the parent's children_range.
+template <class FwdIt, class StatePtr = const void>
+inline std::pair<FwdIt, FwdIt> next_siblings_range(
+		FwdIt node, FwdIt parent, StatePtr* state_ptr) {
+	using fea::children_range;
+	return { ++node, children_range(parent, state_ptr).second };
+}
+
+// Provide children_indices(uint32_t, YourState*) in your state's namespace, or
+// provide children_indices(uint32_t) on your state, to use the index apis.
+// Returns a range of child indices. Children with the maximum value of their
+// index type are considered empty slots and skipped.
+template <class StatePtr>
+inline auto children_indices(uint32_t index, StatePtr* state_ptr)
+		-> decltype(state_ptr->children_indices(index)) {
+	return state_ptr->children_indices(index);
+}
+
+// Specialize children_arity for random access iterators whose children ranges
+// are either empty, or always hold exactly N nodes, by inheriting
+// fixed_arity<N>. For example, octrees, quadtrees and binary trees.
+// Children handling is then unrolled at compile time.
+// An arity of 0 means unknown, the default.
+template <size_t N>
+struct fixed_arity : std::integral_constant<size_t, N> {};
+
+template <class FwdIt>
+struct children_arity : fixed_arity<0> {};
+
+
+namespace detail {
+// Pushes the iterators in [range.first, range.second) at the back of stack,
+// last to first. The first child ends up on top.
+template <class BidirIt>
+inline void push_back_reversed(std::pair<BidirIt, BidirIt> range,
+		std::vector<BidirIt>* stack, std::bidirectional_iterator_tag) {
+	while (range.second != range.first) {
+		stack->push_back(--range.second);
+	}
+}
+
+template <class RandomIt>
+inline void push_back_reversed(std::pair<RandomIt, RandomIt> range,
+		std::vector<RandomIt>* stack, std::random_access_iterator_tag) {
+	size_t num_children = size_t(range.second - range.first);
+	if (num_children == 0) {
+		return;
+	}
+
+	size_t old_size = stack->size();
+	stack->resize(old_size + num_children);
+
+	RandomIt* dst = stack->data() + old_size;
+	for (size_t i = num_children; i > 0; --i) {
+		*dst++ = range.first + (i - 1);
+	}
+}
+
+template <class FwdIt>
+using arity_t = std::integral_constant<size_t, children_arity<FwdIt>::value>;
+
+// Unknown arity.
+template <class BidirIt, class Tag>
+inline void push_back_reversed(std::pair<BidirIt, BidirIt> range,
+		std::vector<BidirIt>* stack, std::integral_constant<size_t, 0>, Tag) {
+	push_back_reversed(range, stack, Tag{});
+}
+
+// Fixed arity, the stack grows by exactly N.
+template <class RandomIt, size_t N, size_t... Is>
+inline void push_back_reversed(RandomIt first, std::vector<RandomIt>* stack,
+		std::integral_constant<size_t, N>, std::index_sequence<Is...>) {
+	size_t old_size = stack->size();
+	stack->resize(old_size + N);
+
+	RandomIt* dst = stack->data() + old_size;
+	using swallow = int[];
+	(void)swallow{ 0, (dst[Is] = first + (N - 1 - Is), 0)... };
+}
+
+template <class RandomIt, size_t N, class Tag>
+inline void push_back_reversed(std::pair<RandomIt, RandomIt> range,
+		std::vector<RandomIt>* stack, std::integral_constant<size_t, N> arity,
+		Tag) {
+	static_assert(std::is_same<Tag, std::random_access_iterator_tag>::value,
+			"children_arity : fixed arity requires random access iterators");
+
+	if (range.first == range.second) {
+		return;
+	}
+	push_back_reversed(
+			range.first, stack, arity, std::make_index_sequence<N>{});
+}
+
+// Pushes the non-culled iterators in [range.first, range.second) at the back
+// of stack, last to first. Unknown arity.
+template <class BidirIt, class CullPredicate, class Tag>
+inline void push_back_reversed_culled(std::pair<BidirIt, BidirIt> range,
+		CullPredicate& cull_pred, std::vector<BidirIt>* stack,
+		std::integral_constant<size_t, 0>, Tag) {
+	// Find first non-culled child.
+	while (range.first != range.second && cull_pred(range.first)) {
+		++range.first;
+	}
+
+	// All children culled.
+	if (range.first == range.second) {
+		return;
+	}
+
+	// Cull remaining children and enqueue in the stack back to front.
+	while (--range.second != range.first) {
+		if (cull_pred(range.second)) {
+			continue;
+		}
+		stack->push_back(range.second);
+	}
+
+	// First child was already evaluated.
+	stack->push_back(range.first);
+}
+
+// Fixed arity. Culls in order, then compacts the survivors without branching.
+template <class RandomIt, class CullPredicate, size_t N, size_t... Is>
+inline void push_back_reversed_culled(RandomIt first, CullPredicate& cull_pred,
+		std::vector<RandomIt>* stack, std::integral_constant<size_t, N>,
+		std::index_sequence<Is...>) {
+	// Braced initializers are evaluated in order.
+	const bool culled[N] = { bool(cull_pred(first + Is))... };
+
+	size_t old_size = stack->size();
+	stack->resize(old_size + N);
+
+	RandomIt* dst = stack->data() + old_size;
+	using swallow = int[];
+	(void)swallow{ 0,
+		(*dst = first + (N - 1 - Is), dst += !culled[N - 1 - Is], 0)... };
+	stack->resize(size_t(dst - stack->data()));
+}
+
+template <class RandomIt, class CullPredicate, size_t N, class Tag>
+inline void push_back_reversed_culled(std::pair<RandomIt, RandomIt> range,
+		CullPredicate& cull_pred, std::vector<RandomIt>* stack,
+		std::integral_constant<size_t, N> arity, Tag) {
+	static_assert(std::is_same<Tag, std::random_access_iterator_tag>::value,
+			"children_arity : fixed arity requires random access iterators");
+
+	if (range.first == range.second) {
+		return;
+	}
+	push_back_reversed_culled(range.first, cull_pred, stack, arity,
+			std::make_index_sequence<N>{});
+}
+} // namespace detail
+
 
 /*
  For Each Functions
@@ -92,26 +280,21 @@ inline void for_each_depthfirst(
 }
 
 
-template <class BidirIt, class Func, class CullPredicate,
-		class StatePtr = const void>
-inline void for_each_depthfirst_flat(BidirIt root, Func func,
-		CullPredicate cull_pred, StatePtr* state_ptr = nullptr) {
-	static_assert(
-			!std::is_same<std::input_iterator_tag,
-					typename std::iterator_traits<BidirIt>::iterator_category>::
-					value,
-			"for_each_flat_depth : iterators must be at minimum bidirectional");
-	static_assert(
-			!std::is_same<std::output_iterator_tag,
-					typename std::iterator_traits<BidirIt>::iterator_category>::
-					value,
-			"for_each_flat_depth : iterators must be at minimum bidirectional");
-	static_assert(
-			!std::is_same<std::forward_iterator_tag,
-					typename std::iterator_traits<BidirIt>::iterator_category>::
-					value,
-			"for_each_flat_depth : iterators must be at minimum bidirectional");
+namespace detail {
+// The flat depth-first stack type. Bidirectional iterators store pending
+// nodes, forward iterators store pending children ranges.
+template <class FwdIt>
+using flat_stack_t = std::conditional_t<
+		std::is_base_of<std::bidirectional_iterator_tag,
+				typename std::iterator_traits<FwdIt>::iterator_category>::value,
+		std::vector<FwdIt>, std::vector<std::pair<FwdIt, FwdIt>>>;
 
+// The stack is provided so it may be reused between calls. It is empty on
+// return.
+template <class BidirIt, class Func, class CullPredicate, class StatePtr>
+inline void for_each_depthfirst_flat(BidirIt root, Func func,
+		CullPredicate cull_pred, StatePtr* state_ptr,
+		std::vector<BidirIt>* stack_ptr, std::bidirectional_iterator_tag) {
 	// Uses a "rolling vector" to flatten out graph and execute function on
 	// those nodes.
 	// For performance reasons, the children are inversed and the vector acts as
@@ -124,7 +307,7 @@ inline void for_each_depthfirst_flat(BidirIt root, Func func,
 		return;
 	}
 
-	std::vector<BidirIt> stack;
+	std::vector<BidirIt>& stack = *stack_ptr;
 	stack.push_back(root);
 
 	while (true) {
@@ -144,205 +327,683 @@ inline void for_each_depthfirst_flat(BidirIt root, Func func,
 		std::pair<BidirIt, BidirIt> range
 				= children_range(current_node, state_ptr);
 
-		// Find first non-culled child.
+		detail::push_back_reversed_culled(range, cull_pred, &stack,
+				detail::arity_t<BidirIt>{},
+				typename std::iterator_traits<BidirIt>::iterator_category{});
+	}
+}
+
+template <class FwdIt, class Func, class CullPredicate, class StatePtr>
+inline void for_each_depthfirst_flat(FwdIt root, Func func,
+		CullPredicate cull_pred, StatePtr* state_ptr,
+		std::vector<std::pair<FwdIt, FwdIt>>* stack_ptr,
+		std::forward_iterator_tag) {
+	// Forward iterators cannot be reversed. Instead, the stack holds the
+	// remaining [current, end) children range of every level, one entry per
+	// depth. Children ranges are walked once, in order.
+
+	if (cull_pred(root)) {
+		return;
+	}
+
+	func(root);
+
+	using fea::children_range;
+	std::vector<std::pair<FwdIt, FwdIt>>& stack = *stack_ptr;
+	stack.push_back(children_range(root, state_ptr));
+
+	while (!stack.empty()) {
+		std::pair<FwdIt, FwdIt>& range = stack.back();
+
+		// Find next non-culled sibling.
 		while (range.first != range.second && cull_pred(range.first)) {
 			++range.first;
 		}
 
-		// All children culled, evaluate next waiting.
+		// Level is exhausted, go back up.
 		if (range.first == range.second) {
+			stack.pop_back();
 			continue;
 		}
 
-		// Cull remaining children and enqueue in the stack back to front.
-		while (--range.second != range.first) {
-			if (cull_pred(range.second)) {
-				continue;
-			}
-			stack.push_back(range.second);
-		}
+		FwdIt current_node = range.first++;
+		func(current_node);
 
-		if (!cull_pred(range.first)) {
-			stack.push_back(range.first);
-		}
+		// Invalidates range.
+		stack.push_back(children_range(current_node, state_ptr));
 	}
 }
 
-// Flat depth-first iteration.
-// Starts at the provided node.
-// Executes func on each node.
-template <class BidirIt, class Func, class StatePtr = const void>
-inline void for_each_depthfirst_flat(
-		BidirIt root, Func func, StatePtr* state_ptr = nullptr) {
+template <class BidirIt, class Func, class StatePtr>
+inline void for_each_depthfirst_flat(BidirIt root, Func func,
+		StatePtr* state_ptr, std::vector<BidirIt>* stack_ptr,
+		std::bidirectional_iterator_tag) {
+	// Same as the culling version, but without a predicate to evaluate the
+	// children can be pushed in bulk. Random access iterators grow the stack
+	// once and reverse-fill it.
 
-	return for_each_depthfirst_flat(
-			root, func, [](BidirIt) { return false; }, state_ptr);
+	std::vector<BidirIt>& stack = *stack_ptr;
+	stack.push_back(root);
+
+	while (!stack.empty()) {
+		BidirIt current_node = stack.back();
+		stack.pop_back();
+		func(current_node);
+
+		using fea::children_range;
+		std::pair<BidirIt, BidirIt> range
+				= children_range(current_node, state_ptr);
+
+		detail::push_back_reversed(range, &stack, detail::arity_t<BidirIt>{},
+				typename std::iterator_traits<BidirIt>::iterator_category{});
+	}
 }
 
-// Flat breadth-first iteration.
-// Fills up a vector internally, use the gather function if you call this on the
-// same graph more than once!
+template <class FwdIt, class Func, class StatePtr>
+inline void for_each_depthfirst_flat(FwdIt root, Func func, StatePtr* state_ptr,
+		std::vector<std::pair<FwdIt, FwdIt>>* stack_ptr,
+		std::forward_iterator_tag) {
+	return detail::for_each_depthfirst_flat(
+			root, func, [](FwdIt) { return false; }, state_ptr, stack_ptr,
+			std::forward_iterator_tag{});
+}
+} // namespace detail
+
+// Flat depth-first iteration.
 // Starts at the provided node.
 // Executes func on each node.
 // CullPredicate accepts an iterator and returns true if the node and its
 // sub-tree should be culled.
-template <class InputIt, class Func, class CullPredicate,
+// Bidirectional iterators use a stack of pending nodes. Forward iterators use
+// a stack of pending children ranges, one per depth.
+template <class FwdIt, class Func, class CullPredicate,
 		class StatePtr = const void>
-inline void for_each_breadthfirst(InputIt root, Func func,
+inline void for_each_depthfirst_flat(FwdIt root, Func func,
 		CullPredicate cull_pred, StatePtr* state_ptr = nullptr) {
-	std::vector<InputIt> graph;
-	gather_breadthfirst(root, cull_pred, &graph, state_ptr);
+	static_assert(
+			std::is_base_of<std::forward_iterator_tag,
+					typename std::iterator_traits<FwdIt>::iterator_category>::
+					value,
+			"for_each_flat_depth : iterators must be at minimum forward");
 
-	for (InputIt it : graph) {
-		func(it);
-	}
+	detail::flat_stack_t<FwdIt> stack;
+	return detail::for_each_depthfirst_flat(root, func, cull_pred, state_ptr,
+			&stack, typename std::iterator_traits<FwdIt>::iterator_category{});
 }
 
-// Flat breadth-first iteration.
-// Fills up a vector internally, use the gather function if you call this on the
-// same graph more than once!
+// Flat depth-first iteration.
 // Starts at the provided node.
 // Executes func on each node.
-template <class InputIt, class Func, class StatePtr = const void>
-inline void for_each_breadthfirst(
-		InputIt root, Func func, StatePtr* state_ptr = nullptr) {
-	std::vector<InputIt> graph;
-	gather_breadthfirst(root, &graph, state_ptr);
+template <class FwdIt, class Func, class StatePtr = const void>
+inline void for_each_depthfirst_flat(
+		FwdIt root, Func func, StatePtr* state_ptr = nullptr) {
+	static_assert(
+			std::is_base_of<std::forward_iterator_tag,
+					typename std::iterator_traits<FwdIt>::iterator_category>::
+					value,
+			"for_each_flat_depth : iterators must be at minimum forward");
 
-	for (InputIt it : graph) {
-		func(it);
+	detail::flat_stack_t<FwdIt> stack;
+	return detail::for_each_depthfirst_flat(root, func, state_ptr, &stack,
+			typename std::iterator_traits<FwdIt>::iterator_category{});
+}
+
+namespace detail {
+// Defers the siblings that follow range.first, under the num_deferred ranges
+// deferred by deeper levels. Returns the new number of deferred ranges.
+template <class FwdIt>
+FEA_FLAT_RECURSE_NOINLINE size_t defer_siblings(std::pair<FwdIt, FwdIt> range,
+		size_t num_deferred, std::vector<std::pair<FwdIt, FwdIt>>* stack) {
+	if (++range.first == range.second) {
+		return num_deferred;
 	}
+	stack->insert(stack->end() - num_deferred, range);
+	return num_deferred + 1;
 }
 
+// Recurses at most depth_left levels below node. Past that, defers the
+// remaining work on the range stack and returns the number of deferred
+// ranges. Remaining siblings are inserted under the deeper ranges, so the
+// stack pops in depth-first order. Kept cheap, this is the hot path.
+template <class FwdIt, class Func, class CullPredicate, class StatePtr>
+inline size_t for_each_depthfirst_hybrid(FwdIt node, Func& func,
+		CullPredicate& cull_pred, StatePtr* state_ptr, size_t depth_left,
+		std::vector<std::pair<FwdIt, FwdIt>>* stack) {
+	func(node);
 
-/*
- Gather Functions
-*/
+	using fea::children_range;
+	std::pair<FwdIt, FwdIt> range = children_range(node, state_ptr);
+	if (depth_left == 0) {
+		if (range.first == range.second) {
+			return 0;
+		}
+		stack->push_back(range);
+		return 1;
+	}
 
-// Gathers nodes using a traditional depth-first recursion.
-// Starts at the provided node.
-// Fills out with depth first ordered iterators.
-// CullPredicate is a predicate function which accepts an iterator, and returns
-// true if the provided node and its sub-tree should be culled.
-template <class InputIt, class CullPredicate, class StatePtr = const void>
-inline void gather_depthfirst(InputIt root, std::vector<InputIt>* out,
-		CullPredicate cull_pred, StatePtr* state_ptr = nullptr) {
-	out->clear();
+	for (; range.first != range.second; ++range.first) {
+		if (cull_pred(range.first)) {
+			continue;
+		}
 
-	return for_each_depthfirst(
-			root, [&](InputIt node) { out->push_back(node); }, cull_pred,
-			state_ptr);
+		size_t num_deferred = for_each_depthfirst_hybrid(range.first, func,
+				cull_pred, state_ptr, depth_left - 1, stack);
+		if (num_deferred != 0) {
+			return defer_siblings(range, num_deferred, stack);
+		}
+	}
+	return 0;
 }
+} // namespace detail
 
-// Gathers nodes using a traditional depth-first recursion.
+// Hybrid depth-first iteration.
+// Sub-trees are visited with recursion, up to max_recursion levels deep.
+// Deeper sub-trees continue from an explicit stack, like
+// for_each_depthfirst_flat. Visits nodes in the same order as
+// for_each_depthfirst, without its stack overflows on deep trees.
 // Starts at the provided node.
-// Fills out with depth first ordered iterators.
-template <class InputIt, class StatePtr = const void>
-inline void gather_depthfirst(InputIt root, std::vector<InputIt>* out,
-		StatePtr* state_ptr = nullptr) {
+// Executes func on each node.
+// CullPredicate accepts an iterator and returns true if the node and its
+// sub-tree should be culled.
+template <class FwdIt, class Func, class CullPredicate,
+		class StatePtr = const void>
+inline void for_each_depthfirst_hybrid(FwdIt root, Func func,
+		CullPredicate cull_pred, StatePtr* state_ptr = nullptr,
+		size_t max_recursion = 16) {
+	static_assert(
+			std::is_base_of<std::forward_iterator_tag,
+					typename std::iterator_traits<FwdIt>::iterator_category>::
+					value,
+			"for_each_depthfirst_hybrid : iterators must be at minimum "
+			"forward");
 
-	return gather_depthfirst(
-			root, out, [](InputIt) { return false; }, state_ptr);
-}
+	if (cull_pred(root)) {
+		return;
+	}
 
+	std::vector<std::pair<FwdIt, FwdIt>> stack;
+	if (detail::for_each_depthfirst_hybrid(
+				root, func, cull_pred, state_ptr, max_recursion, &stack)
+			== 0) {
+		return;
+	}
 
-// Gathers a depth-first flat vector without recursing.
-// Starts at the provided node.
-// Returns depth first ordered iterators.
-// CullPredicate is a predicate function which accepts an iterator, and returns
-// true if the provided node and its sub-tree should be culled.
-template <class BidirIt, class CullPredicate, class StatePtr = const void>
-inline void gather_depthfirst_flat(BidirIt root, CullPredicate cull_pred,
-		std::vector<BidirIt>* out, StatePtr* state_ptr = nullptr) {
-	out->clear();
+	while (!stack.empty()) {
+		std::pair<FwdIt, FwdIt>& range = stack.back();
 
-	return for_each_depthfirst_flat(
-			root, [&](BidirIt node) { out->push_back(node); }, cull_pred,
-			state_ptr);
+		// Find next non-culled sibling.
+		while (range.first != range.second && cull_pred(range.first)) {
+			++range.first;
+		}
+
+		// Level is exhausted, go back up.
+		if (range.first == range.second) {
+			stack.pop_back();
+			continue;
+		}
+
+		// Invalidates range.
+		FwdIt current_node = range.first++;
+		detail::for_each_depthfirst_hybrid(current_node, func, cull_pred,
+				state_ptr, max_recursion, &stack);
+	}
 }
 
-// Gathers a depth-first flat vector without recursing.
+// Hybrid depth-first iteration.
+// Sub-trees are visited with recursion, up to max_recursion levels deep.
+// Deeper sub-trees continue from an explicit stack, like
+// for_each_depthfirst_flat. Visits nodes in the same order as
+// for_each_depthfirst, without its stack overflows on deep trees.
 // Starts at the provided node.
-// Returns depth first ordered iterators.
-template <class BidirIt, class StatePtr = const void>
-inline void gather_depthfirst_flat(BidirIt root, std::vector<BidirIt>* out,
-		StatePtr* state_ptr = nullptr) {
-	return gather_depthfirst_flat(
-			root, [](BidirIt) { return false; }, out, state_ptr);
+// Executes func on each node.
+template <class FwdIt, class Func, class StatePtr = const void>
+inline void for_each_depthfirst_hybrid(FwdIt root, Func func,
+		StatePtr* state_ptr = nullptr, size_t max_recursion = 16) {
+	return for_each_depthfirst_hybrid(
+			root, func, [](FwdIt) { return false; }, state_ptr,
+			max_recursion);
 }
 
-
-// Gathers a breadth-first flat vector without recursing.
+// Stackless depth-first iteration.
+// Uses parent_node and next_siblings_range to climb back up the tree, no
+// memory is allocated.
 // Starts at the provided node.
-// Returns breadth first ordered iterators.
-// CullPredicate is a predicate function which accepts an iterator, and returns
-// true if the provided node and its sub-tree should be culled.
-template <class InputIt, class CullPredicate, class StatePtr = const void>
-inline void gather_breadthfirst(InputIt root, CullPredicate cull_pred,
-		std::vector<InputIt>* out, StatePtr* state_ptr = nullptr) {
-	// Grab children, pushback range if not culled, rince-repeat.
-	// Continue looping the vector until you reach end.
-
-	out->clear();
+// Executes func on each node, parents before children.
+// CullPredicate accepts an iterator and returns true if the node and its
+// sub-tree should be culled.
+template <class FwdIt, class Func, class CullPredicate,
+		class StatePtr = const void>
+inline void for_each_depthfirst_stackless(FwdIt root, Func func,
+		CullPredicate cull_pred, StatePtr* state_ptr = nullptr) {
 	if (cull_pred(root)) {
 		return;
 	}
 
-	out->push_back(root);
+	using fea::children_range;
+	using fea::next_siblings_range;
+	using fea::parent_node;
 
-	for (size_t i = 0; i < out->size(); ++i) {
-		using fea::children_range;
-		std::pair<InputIt, InputIt> range
-				= children_range((*out)[i], state_ptr);
+	FwdIt current_node = root;
+	while (true) {
+		func(current_node);
 
-		for (InputIt it = range.first; it != range.second; ++it) {
-			if (cull_pred(it)) {
-				continue;
+		// Go down to first non-culled child.
+		std::pair<FwdIt, FwdIt> range
+				= children_range(current_node, state_ptr);
+		while (range.first != range.second && cull_pred(range.first)) {
+			++range.first;
+		}
+
+		if (range.first != range.second) {
+			current_node = range.first;
+			continue;
+		}
+
+		// Leaf, go up until we find a non-culled next sibling.
+		while (true) {
+			if (current_node == root) {
+				// We are done.
+				return;
 			}
 
-			out->push_back(it);
+			FwdIt parent = parent_node(current_node, state_ptr);
+			range = next_siblings_range(current_node, parent, state_ptr);
+			while (range.first != range.second && cull_pred(range.first)) {
+				++range.first;
+			}
+
+			if (range.first != range.second) {
+				current_node = range.first;
+				break;
+			}
+			current_node = parent;
 		}
 	}
 }
 
-// Gathers a breadth-first flat vector without recursing.
+// Stackless depth-first iteration.
+// Uses parent_node and next_siblings_range to climb back up the tree, no
+// memory is allocated.
 // Starts at the provided node.
-// Returns breadth first ordered iterators.
-template <class InputIt, class StatePtr = const void>
-inline void gather_breadthfirst(InputIt root, std::vector<InputIt>* out,
-		StatePtr* state_ptr = nullptr) {
-	return gather_breadthfirst(
-			root, [](InputIt) { return false; }, out, state_ptr);
+// Executes func on each node, parents before children.
+template <class FwdIt, class Func, class StatePtr = const void>
+inline void for_each_depthfirst_stackless(
+		FwdIt root, Func func, StatePtr* state_ptr = nullptr) {
+	return for_each_depthfirst_stackless(
+			root, func, [](FwdIt) { return false; }, state_ptr);
 }
 
-
-// Gathers a breadth-first vector of vector without recursing. Sub vectors are
-// the breadths. Useful for multithreading.
+// Stackless post-order depth-first iteration.
+// Uses parent_node and next_siblings_range to climb back up the tree, no
+// memory is allocated.
 // Starts at the provided node.
-// Returns vector of breadth iterator vectors.
-// CullPredicate is a predicate function which accepts an iterator, and returns
-// true if the provided node and its sub-tree should be culled.
-template <class InputIt, class CullPredicate, class StatePtr = const void>
-inline void gather_breadthfirst_staged(InputIt root, CullPredicate cull_pred,
-		std::vector<std::vector<InputIt>>* out, StatePtr* state_ptr = nullptr) {
-	out->clear();
-
+// Executes func on each node, children before parents.
+// CullPredicate accepts an iterator and returns true if the node and its
+// sub-tree should be culled.
+template <class FwdIt, class Func, class CullPredicate,
+		class StatePtr = const void>
+inline void for_each_depthfirst_postorder_stackless(FwdIt root, Func func,
+		CullPredicate cull_pred, StatePtr* state_ptr = nullptr) {
 	if (cull_pred(root)) {
 		return;
 	}
 
-	out->push_back({ root });
+	using fea::children_range;
+	using fea::next_siblings_range;
+	using fea::parent_node;
 
-	for (size_t i = 0; i < out->size(); ++i) {
-		for (size_t j = 0; j < (*out)[i].size(); ++j) {
-			using fea::children_range;
+	// Goes down the first non-culled children, until reaching a leaf.
+	auto descend = [&](FwdIt node) {
+		while (true) {
+			std::pair<FwdIt, FwdIt> range = children_range(node, state_ptr);
+			while (range.first != range.second && cull_pred(range.first)) {
+				++range.first;
+			}
+
+			if (range.first == range.second) {
+				return node;
+			}
+			node = range.first;
+		}
+	};
+
+	FwdIt current_node = descend(root);
+	while (true) {
+		func(current_node);
+
+		if (current_node == root) {
+			// We are done.
+			return;
+		}
+
+		// Visit the next non-culled sibling sub-tree, or the parent once
+		// all its children are done.
+		FwdIt parent = parent_node(current_node, state_ptr);
+		std::pair<FwdIt, FwdIt> range
+				= next_siblings_range(current_node, parent, state_ptr);
+		while (range.first != range.second && cull_pred(range.first)) {
+			++range.first;
+		}
+
+		if (range.first != range.second) {
+			current_node = descend(range.first);
+		} else {
+			current_node = parent;
+		}
+	}
+}
+
+// Stackless post-order depth-first iteration.
+// Uses parent_node and next_siblings_range to climb back up the tree, no
+// memory is allocated.
+// Starts at the provided node.
+// Executes func on each node, children before parents.
+template <class FwdIt, class Func, class StatePtr = const void>
+inline void for_each_depthfirst_postorder_stackless(
+		FwdIt root, Func func, StatePtr* state_ptr = nullptr) {
+	return for_each_depthfirst_postorder_stackless(
+			root, func, [](FwdIt) { return false; }, state_ptr);
+}
+
+// Flat depth-first iteration, with ancestors.
+// Maintains the path from root to the current node, updated as nodes are
+// pushed and popped.
+// Starts at the provided node.
+// Executes func on each node, parents before children. Func accepts a
+// const std::vector<FwdIt>& path. path.front() is root, path.back() is the
+// current node. The path is only valid during the call.
+// CullPredicate accepts the same path and returns true if path.back() and its
+// sub-tree should be culled.
+template <class FwdIt, class Func, class CullPredicate,
+		class StatePtr = const void>
+inline void for_each_depthfirst_path(FwdIt root, Func func,
+		CullPredicate cull_pred, StatePtr* state_ptr = nullptr) {
+	static_assert(
+			std::is_base_of<std::forward_iterator_tag,
+					typename std::iterator_traits<FwdIt>::iterator_category>::
+					value,
+			"for_each_depthfirst_path : iterators must be at minimum forward");
+
+	// Users only get read access.
+	std::vector<FwdIt> path;
+	const std::vector<FwdIt>& cpath = path;
+	path.push_back(root);
+	if (cull_pred(cpath)) {
+		return;
+	}
+	func(cpath);
+
+	// stack[i] holds the remaining children of path[i].
+	using fea::children_range;
+	std::vector<std::pair<FwdIt, FwdIt>> stack;
+	stack.push_back(children_range(root, state_ptr));
+
+	while (!stack.empty()) {
+		std::pair<FwdIt, FwdIt>& range = stack.back();
+		if (range.first == range.second) {
+			stack.pop_back();
+			path.pop_back();
+			continue;
+		}
+
+		FwdIt current_node = range.first++;
+		path.push_back(current_node);
+		if (cull_pred(cpath)) {
+			path.pop_back();
+			continue;
+		}
+		func(cpath);
+
+		// Invalidates range.
+		stack.push_back(children_range(current_node, state_ptr));
+	}
+}
+
+// Flat depth-first iteration, with ancestors.
+// Maintains the path from root to the current node, updated as nodes are
+// pushed and popped.
+// Starts at the provided node.
+// Executes func on each node, parents before children. Func accepts a
+// const std::vector<FwdIt>& path. path.front() is root, path.back() is the
+// current node. The path is only valid during the call.
+template <class FwdIt, class Func, class StatePtr = const void>
+inline void for_each_depthfirst_path(
+		FwdIt root, Func func, StatePtr* state_ptr = nullptr) {
+	return for_each_depthfirst_path(
+			root, func, [](const std::vector<FwdIt>&) { return false; },
+			state_ptr);
+}
+
+// Flat breadth-first iteration.
+// Fills up a vector internally, use the gather function if you call this on the
+// same graph more than once!
+// Starts at the provided node.
+// Executes func on each node.
+// CullPredicate accepts an iterator and returns true if the node and its
+// sub-tree should be culled.
+template <class InputIt, class Func, class CullPredicate,
+		class StatePtr = const void>
+inline void for_each_breadthfirst(InputIt root, Func func,
+		CullPredicate cull_pred, StatePtr* state_ptr = nullptr) {
+	if (cull_pred(root)) {
+		return;
+	}
+
+	// Same as gather_breadthfirst, which is declared later.
+	std::vector<InputIt> graph;
+	graph.push_back(root);
+	for (size_t i = 0; i < graph.size(); ++i) {
+		using fea::children_range;
+		std::pair<InputIt, InputIt> range = children_range(graph[i], state_ptr);
+
+		for (InputIt it = range.first; it != range.second; ++it) {
+			if (cull_pred(it)) {
+				continue;
+			}
+			graph.push_back(it);
+		}
+	}
+
+	for (InputIt it : graph) {
+		func(it);
+	}
+}
+
+// Flat breadth-first iteration.
+// Fills up a vector internally, use the gather function if you call this on the
+// same graph more than once!
+// Starts at the provided node.
+// Executes func on each node.
+template <class InputIt, class Func, class StatePtr = const void>
+inline void for_each_breadthfirst(
+		InputIt root, Func func, StatePtr* state_ptr = nullptr) {
+	return for_each_breadthfirst(
+			root, func, [](InputIt) { return false; }, state_ptr);
+}
+
+
+/*
+ Resumable Traversals
+*/
+
+// Depth-first traversal which can be paused and resumed, to spread the work
+// over multiple frames. Holds the explicit stack between calls.
+// Visits nodes in the same order as for_each_depthfirst.
+// The tree must not be modified while a traversal is in progress.
+// Use make_resumable_depthfirst to create one.
+template <class FwdIt, class Func, class CullPredicate, class StatePtr>
+struct resumable_depthfirst {
+	static_assert(
+			std::is_base_of<std::forward_iterator_tag,
+					typename std::iterator_traits<FwdIt>::iterator_category>::
+					value,
+			"resumable_depthfirst : iterators must be at minimum forward");
+
+	resumable_depthfirst(FwdIt root, Func func, CullPredicate cull_pred,
+			StatePtr* state_ptr)
+			: _func(func)
+			, _cull_pred(cull_pred)
+			, _state_ptr(state_ptr) {
+		reset(root);
+	}
+
+	// Restarts the traversal at root.
+	void reset(FwdIt root) {
+		_stack.clear();
+		FwdIt next = root;
+		_stack.push_back({ root, ++next });
+	}
+
+	// Returns true once all nodes are visited.
+	bool done() const {
+		return _stack.empty();
+	}
+
+	// Visits at most max_nodes nodes.
+	// Returns true once all nodes are visited.
+	bool step(size_t max_nodes) {
+		// Same as the forward iterator for_each_depthfirst_flat. The stack
+		// holds the remaining [current, end) range of every depth.
+		size_t num_visited = 0;
+		while (num_visited < max_nodes && !_stack.empty()) {
+			std::pair<FwdIt, FwdIt>& range = _stack.back();
+
+			// Find next non-culled sibling.
+			while (range.first != range.second && _cull_pred(range.first)) {
+				++range.first;
+			}
+
+			// Level is exhausted, go back up.
+			if (range.first == range.second) {
+				_stack.pop_back();
+				continue;
+			}
+
+			FwdIt current_node = range.first++;
+			_func(current_node);
+			++num_visited;
+
+			// Invalidates range.
+			using fea::children_range;
+			_stack.push_back(children_range(current_node, _state_ptr));
+		}
+
+		return _stack.empty();
+	}
+
+	// Visits nodes until budget is spent. The clock is checked every
+	// check_interval nodes.
+	// Returns true once all nodes are visited.
+	template <class Rep, class Period>
+	bool run_for(std::chrono::duration<Rep, Period> budget,
+			size_t check_interval = 64) {
+		using clock = std::chrono::steady_clock;
+		clock::time_point end = clock::now()
+				+ std::chrono::duration_cast<clock::duration>(budget);
+
+		while (!step(check_interval)) {
+			if (clock::now() >= end) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Reserves the stack of a tree max_depth deep, root included. See
+	// profile_tree.
+	void reserve(size_t max_depth) {
+		_stack.reserve(max_depth + 1);
+	}
+
+private:
+	std::vector<std::pair<FwdIt, FwdIt>> _stack;
+	Func _func;
+	CullPredicate _cull_pred;
+	StatePtr* _state_ptr;
+};
+
+// Creates a resumable depth-first traversal starting at the provided node.
+// Executes func on each node.
+// CullPredicate accepts an iterator and returns true if the node and its
+// sub-tree should be culled.
+template <class FwdIt, class Func, class CullPredicate,
+		class StatePtr = const void>
+inline resumable_depthfirst<FwdIt, Func, CullPredicate, StatePtr>
+make_resumable_depthfirst(FwdIt root, Func func, CullPredicate cull_pred,
+		StatePtr* state_ptr = nullptr) {
+	return { root, func, cull_pred, state_ptr };
+}
+
+namespace detail {
+template <class FwdIt>
+struct never_cull {
+	bool operator()(FwdIt) const {
+		return false;
+	}
+};
+} // namespace detail
+
+// Creates a resumable depth-first traversal starting at the provided node.
+// Executes func on each node.
+template <class FwdIt, class Func, class StatePtr = const void>
+inline resumable_depthfirst<FwdIt, Func, detail::never_cull<FwdIt>, StatePtr>
+make_resumable_depthfirst(
+		FwdIt root, Func func, StatePtr* state_ptr = nullptr) {
+	return { root, func, detail::never_cull<FwdIt>{}, state_ptr };
+}
+
+
+/*
+ Gather Functions
+*/
+
+namespace detail {
+// Breadth-first expands the nodes already in out.
+template <class InputIt, class CullPredicate, class StatePtr>
+inline void expand_breadthfirst(CullPredicate cull_pred,
+		std::vector<InputIt>* out, StatePtr* state_ptr) {
+	// Grab children, pushback range if not culled, rince-repeat.
+	// Continue looping the vector until you reach end.
+	for (size_t i = 0; i < out->size(); ++i) {
+		using fea::children_range;
+		std::pair<InputIt, InputIt> range
+				= children_range((*out)[i], state_ptr);
+
+		for (InputIt it = range.first; it != range.second; ++it) {
+			if (cull_pred(it)) {
+				continue;
+			}
+
+			out->push_back(it);
+		}
+	}
+}
+
+// Breadth-first expands the nodes already in the first breadth of out.
+// The following breadths are reused and keep their capacity, out is resized
+// to the breadth count.
+template <class InputIt, class CullPredicate, class StatePtr>
+inline void expand_breadthfirst_staged(CullPredicate cull_pred,
+		std::vector<std::vector<InputIt>>* out, StatePtr* state_ptr) {
+	size_t num_breadths = 1;
+	for (size_t i = 0; i < num_breadths; ++i) {
+		for (size_t j = 0; j < (*out)[i].size(); ++j) {
+			using fea::children_range;
 			std::pair<InputIt, InputIt> range
 					= children_range((*out)[i][j], state_ptr);
 
-			if (out->size() == i + 1 && range.first != range.second) {
-				out->push_back({});
-				// Expect at least as much as previous.
-				out->back().reserve((*out)[i].size());
+			if (num_breadths == i + 1 && range.first != range.second) {
+				if (out->size() == num_breadths) {
+					out->push_back({});
+				}
+				++num_breadths;
+				(*out)[i + 1].clear();
+
+				// Expect at least as much as previous, or exactly arity times
+				// as much when it is known.
+				constexpr size_t arity = children_arity<InputIt>::value;
+				(*out)[i + 1].reserve(
+						(*out)[i].size() * (arity == 0 ? 1 : arity));
 			}
 
 			for (InputIt it = range.first; it != range.second; ++it) {
@@ -353,6 +1014,114 @@ inline void gather_breadthfirst_staged(InputIt root, CullPredicate cull_pred,
 			}
 		}
 	}
+	out->resize(num_breadths);
+}
+} // namespace detail
+
+// Gathers nodes using a traditional depth-first recursion.
+// Starts at the provided node.
+// Fills out with depth first ordered iterators.
+// CullPredicate is a predicate function which accepts an iterator, and returns
+// true if the provided node and its sub-tree should be culled.
+template <class InputIt, class CullPredicate, class StatePtr = const void>
+inline void gather_depthfirst(InputIt root, std::vector<InputIt>* out,
+		CullPredicate cull_pred, StatePtr* state_ptr = nullptr) {
+	out->clear();
+
+	return for_each_depthfirst(
+			root, [&](InputIt node) { out->push_back(node); }, cull_pred,
+			state_ptr);
+}
+
+// Gathers nodes using a traditional depth-first recursion.
+// Starts at the provided node.
+// Fills out with depth first ordered iterators.
+template <class InputIt, class StatePtr = const void>
+inline void gather_depthfirst(InputIt root, std::vector<InputIt>* out,
+		StatePtr* state_ptr = nullptr) {
+
+	return gather_depthfirst(
+			root, out, [](InputIt) { return false; }, state_ptr);
+}
+
+
+// Gathers a depth-first flat vector without recursing.
+// Starts at the provided node.
+// Returns depth first ordered iterators.
+// CullPredicate is a predicate function which accepts an iterator, and returns
+// true if the provided node and its sub-tree should be culled.
+template <class FwdIt, class CullPredicate, class StatePtr = const void>
+inline void gather_depthfirst_flat(FwdIt root, CullPredicate cull_pred,
+		std::vector<FwdIt>* out, StatePtr* state_ptr = nullptr) {
+	out->clear();
+
+	return for_each_depthfirst_flat(
+			root, [&](FwdIt node) { out->push_back(node); }, cull_pred,
+			state_ptr);
+}
+
+// Gathers a depth-first flat vector without recursing.
+// Starts at the provided node.
+// Returns depth first ordered iterators.
+template <class FwdIt, class StatePtr = const void>
+inline void gather_depthfirst_flat(FwdIt root, std::vector<FwdIt>* out,
+		StatePtr* state_ptr = nullptr) {
+	out->clear();
+
+	return for_each_depthfirst_flat(
+			root, [&](FwdIt node) { out->push_back(node); }, state_ptr);
+}
+
+
+// Gathers a breadth-first flat vector without recursing.
+// Starts at the provided node.
+// Returns breadth first ordered iterators.
+// CullPredicate is a predicate function which accepts an iterator, and returns
+// true if the provided node and its sub-tree should be culled.
+template <class InputIt, class CullPredicate, class StatePtr = const void>
+inline void gather_breadthfirst(InputIt root, CullPredicate cull_pred,
+		std::vector<InputIt>* out, StatePtr* state_ptr = nullptr) {
+	out->clear();
+	if (cull_pred(root)) {
+		return;
+	}
+
+	out->push_back(root);
+	detail::expand_breadthfirst(cull_pred, out, state_ptr);
+}
+
+// Gathers a breadth-first flat vector without recursing.
+// Starts at the provided node.
+// Returns breadth first ordered iterators.
+template <class InputIt, class StatePtr = const void>
+inline void gather_breadthfirst(InputIt root, std::vector<InputIt>* out,
+		StatePtr* state_ptr = nullptr) {
+	return gather_breadthfirst(
+			root, [](InputIt) { return false; }, out, state_ptr);
+}
+
+
+// Gathers a breadth-first vector of vector without recursing. Sub vectors are
+// the breadths. Useful for multithreading.
+// Starts at the provided node.
+// Returns vector of breadth iterator vectors.
+// CullPredicate is a predicate function which accepts an iterator, and returns
+// true if the provided node and its sub-tree should be culled.
+template <class InputIt, class CullPredicate, class StatePtr = const void>
+inline void gather_breadthfirst_staged(InputIt root, CullPredicate cull_pred,
+		std::vector<std::vector<InputIt>>* out, StatePtr* state_ptr = nullptr) {
+	if (cull_pred(root)) {
+		out->clear();
+		return;
+	}
+
+	// Breadths are reused, keep out around to reuse its memory.
+	if (out->empty()) {
+		out->push_back({});
+	}
+	out->front().clear();
+	out->front().push_back(root);
+	detail::expand_breadthfirst_staged(cull_pred, out, state_ptr);
 }
 
 // Gathers a breadth-first vector of vector without recursing. Sub vectors are
@@ -365,4 +1134,2231 @@ inline void gather_breadthfirst_staged(InputIt root,
 	gather_breadthfirst_staged(
 			root, [](InputIt) { return false; }, out, state_ptr);
 }
+
+
+/*
+ Tree Profiling
+*/
+
+enum class traversal_kind {
+	depthfirst,
+	breadthfirst,
+	breadthfirst_staged,
+};
+
+// The shape of a tree, returned by profile_tree. Depths count the root.
+// Use it to reserve gather outputs and traversal stacks exactly.
+// Sampled profiles hold estimates.
+struct tree_profile {
+	size_t num_nodes = 0;
+	size_t num_leaves = 0;
+	size_t max_depth = 0;
+
+	// The node count of every depth. level_widths[0] is the root.
+	std::vector<size_t> level_widths;
+
+	// branching_histogram[n] is the count of nodes with n children.
+	std::vector<size_t> branching_histogram;
+
+	bool sampled = false;
+
+	size_t max_width() const {
+		return level_widths.empty()
+				? 0
+				: *std::max_element(level_widths.begin(), level_widths.end());
+	}
+
+	// The average children count of non-leaf nodes.
+	double average_branching() const {
+		size_t num_parents = num_nodes - num_leaves;
+		return num_parents == 0 ? 0.0
+								: double(num_nodes - 1) / double(num_parents);
+	}
+
+	// Reserves a flat gather output.
+	template <class It>
+	void reserve(std::vector<It>* out) const {
+		out->reserve(num_nodes);
+	}
+
+	// Reserves a staged gather output, every breadth holds its level.
+	template <class It>
+	void reserve(std::vector<std::vector<It>>* out) const {
+		if (out->size() < level_widths.size()) {
+			out->resize(level_widths.size());
+		}
+		for (size_t i = 0; i < level_widths.size(); ++i) {
+			(*out)[i].reserve(level_widths[i]);
+		}
+	}
+
+	// Recommends a traversal for this shape.
+	// Staged breadth-first when levels are wide enough to split into
+	// parallel or vectorized work, at least 1024 nodes on average.
+	// Breadth-first for shallow and bushy trees, at most 4 levels and 16
+	// children per node on average, siblings are visited back to back.
+	// Otherwise depth-first, which only stores a stack as deep as the tree.
+	traversal_kind recommended_traversal() const {
+		if (max_depth != 0 && num_nodes / max_depth >= 1024) {
+			return traversal_kind::breadthfirst_staged;
+		}
+		if (max_depth <= 4 && average_branching() >= 16.0) {
+			return traversal_kind::breadthfirst;
+		}
+		return traversal_kind::depthfirst;
+	}
+};
+
+namespace detail {
+// Accumulates weighted counts, weights are estimates of how many nodes a
+// sampled node stands for.
+struct profile_counts {
+	void add(size_t depth, size_t num_children, double weight) {
+		if (level_widths.size() <= depth) {
+			level_widths.resize(depth + 1, 0.0);
+		}
+		if (branching_histogram.size() <= num_children) {
+			branching_histogram.resize(num_children + 1, 0.0);
+		}
+
+		num_nodes += weight;
+		level_widths[depth] += weight;
+		branching_histogram[num_children] += weight;
+		if (num_children == 0) {
+			num_leaves += weight;
+		}
+	}
+
+	tree_profile to_profile(bool sampled) const {
+		auto round = [](double v) { return size_t(v + 0.5); };
+
+		tree_profile ret;
+		ret.num_nodes = round(num_nodes);
+		ret.num_leaves = round(num_leaves);
+		ret.max_depth = level_widths.size();
+		ret.sampled = sampled;
+		for (double w : level_widths) {
+			ret.level_widths.push_back(round(w));
+		}
+		for (double w : branching_histogram) {
+			ret.branching_histogram.push_back(round(w));
+		}
+		return ret;
+	}
+
+	double num_nodes = 0.0;
+	double num_leaves = 0.0;
+	std::vector<double> level_widths;
+	std::vector<double> branching_histogram;
+};
+} // namespace detail
+
+// Measures the shape of the tree, in a single depth-first pass.
+// Starts at the provided node.
+// CullPredicate accepts an iterator and returns true if the node and its
+// sub-tree should be culled. Culled children aren't counted.
+template <class FwdIt, class CullPredicate, class StatePtr = const void>
+inline tree_profile profile_tree(
+		FwdIt root, CullPredicate cull_pred, StatePtr* state_ptr = nullptr) {
+	static_assert(
+			std::is_base_of<std::forward_iterator_tag,
+					typename std::iterator_traits<FwdIt>::iterator_category>::
+					value,
+			"profile_tree : iterators must be at minimum forward");
+
+	detail::profile_counts counts;
+	if (cull_pred(root)) {
+		return counts.to_profile(false);
+	}
+
+	// Pending nodes and their depth.
+	std::vector<std::pair<FwdIt, size_t>> stack;
+	stack.push_back({ root, 0 });
+	while (!stack.empty()) {
+		std::pair<FwdIt, size_t> current = stack.back();
+		stack.pop_back();
+
+		using fea::children_range;
+		std::pair<FwdIt, FwdIt> range
+				= children_range(current.first, state_ptr);
+
+		size_t num_children = 0;
+		for (; range.first != range.second; ++range.first) {
+			if (cull_pred(range.first)) {
+				continue;
+			}
+			stack.push_back({ range.first, current.second + 1 });
+			++num_children;
+		}
+		counts.add(current.second, num_children, 1.0);
+	}
+
+	return counts.to_profile(false);
+}
+
+// Measures the shape of the tree, in a single depth-first pass.
+// Starts at the provided node.
+template <class FwdIt, class StatePtr = const void>
+inline tree_profile profile_tree(FwdIt root, StatePtr* state_ptr = nullptr) {
+	return profile_tree(root, [](FwdIt) { return false; }, state_ptr);
+}
+
+// Estimates the shape of huge trees.
+// Descends into at most max_samples evenly spaced children per node. Every
+// sampled child stands for its share of the siblings, counts are scaled
+// accordingly. Exact when no node has more than max_samples children.
+// Starts at the provided node.
+// CullPredicate accepts an iterator and returns true if the node and its
+// sub-tree should be culled. Culled children aren't counted.
+template <class FwdIt, class CullPredicate, class StatePtr = const void>
+inline tree_profile profile_tree_sampled(FwdIt root, size_t max_samples,
+		CullPredicate cull_pred, StatePtr* state_ptr = nullptr) {
+	static_assert(
+			std::is_base_of<std::forward_iterator_tag,
+					typename std::iterator_traits<FwdIt>::iterator_category>::
+					value,
+			"profile_tree_sampled : iterators must be at minimum forward");
+
+	max_samples = (std::max)(max_samples, size_t(1));
+
+	detail::profile_counts counts;
+	if (cull_pred(root)) {
+		return counts.to_profile(true);
+	}
+
+	struct pending {
+		FwdIt node;
+		size_t depth;
+		double weight;
+	};
+
+	std::vector<pending> stack;
+	std::vector<FwdIt> children;
+	stack.push_back({ root, 0, 1.0 });
+	while (!stack.empty()) {
+		pending current = stack.back();
+		stack.pop_back();
+
+		children.clear();
+		using fea::children_range;
+		std::pair<FwdIt, FwdIt> range
+				= children_range(current.node, state_ptr);
+		for (; range.first != range.second; ++range.first) {
+			if (cull_pred(range.first)) {
+				continue;
+			}
+			children.push_back(range.first);
+		}
+		counts.add(current.depth, children.size(), current.weight);
+
+		size_t num_samples = (std::min)(children.size(), max_samples);
+		if (num_samples == 0) {
+			continue;
+		}
+
+		double child_weight = current.weight * double(children.size())
+				/ double(num_samples);
+		for (size_t i = 0; i < num_samples; ++i) {
+			size_t child_idx = i * children.size() / num_samples;
+			stack.push_back(
+					{ children[child_idx], current.depth + 1, child_weight });
+		}
+	}
+
+	return counts.to_profile(true);
+}
+
+// Estimates the shape of huge trees.
+// Descends into at most max_samples evenly spaced children per node. Every
+// sampled child stands for its share of the siblings, counts are scaled
+// accordingly. Exact when no node has more than max_samples children.
+// Starts at the provided node.
+template <class FwdIt, class StatePtr = const void>
+inline tree_profile profile_tree_sampled(
+		FwdIt root, size_t max_samples, StatePtr* state_ptr = nullptr) {
+	return profile_tree_sampled(
+			root, max_samples, [](FwdIt) { return false; }, state_ptr);
+}
+
+
+/*
+ Executors
+*/
+
+// The parallel apis run on an executor, so they share your job system
+// instead of spawning threads. An executor provides :
+// - void submit(Task task) : runs task() asynchronously.
+// - void bulk(size_t n, Func func) : runs func(i) for every i in [0, n) and
+//   returns once all calls completed. The calling thread may participate.
+// - size_t concurrency() const : the number of threads tasks may run on.
+//
+// inline_executor runs everything on the calling thread.
+// work_stealing_pool is a built-in thread pool.
+// executor_adapter wraps your pool, which must provide submit(task).
+// The overloads which don't take an executor run on default_executor(), a
+// single process-wide pool. They never create threads per call.
+
+namespace detail {
+template <class...>
+using void_t = void;
+
+template <class T, class = void>
+struct is_executor : std::false_type {};
+
+template <class T>
+struct is_executor<T,
+		void_t<decltype(std::declval<const T&>().concurrency())>>
+		: std::true_type {};
+
+// Shared by the caller and the helper tasks of a bulk call. Helpers may start
+// after the call returned, they only touch func while indices remain.
+template <class Func>
+struct bulk_state {
+	bulk_state(size_t n_, Func* func_)
+			: n(n_)
+			, func(func_) {
+	}
+
+	// Runs indices until none remain.
+	void run() {
+		size_t num_ran = 0;
+		for (size_t i = next.fetch_add(1, std::memory_order_relaxed); i < n;
+				i = next.fetch_add(1, std::memory_order_relaxed)) {
+			(*func)(i);
+			++num_ran;
+		}
+
+		if (num_ran == 0) {
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock{ mutex };
+		num_completed += num_ran;
+		if (num_completed == n) {
+			cv.notify_all();
+		}
+	}
+
+	// Waits until every index completed.
+	void wait() {
+		std::unique_lock<std::mutex> lock{ mutex };
+		cv.wait(lock, [this]() { return num_completed == n; });
+	}
+
+	const size_t n;
+	Func* const func;
+	std::atomic<size_t> next{ 0 };
+	size_t num_completed = 0;
+	std::mutex mutex;
+	std::condition_variable cv;
+};
+
+// Implements bulk with submit. Submits up to concurrency - 1 helpers, which
+// pull indices alongside the calling thread. Queued helpers never block the
+// caller, so nested bulk calls cannot deadlock.
+template <class Executor, class Func>
+inline void bulk_with_submit(Executor& executor, size_t n, Func& func) {
+	if (n == 0) {
+		return;
+	}
+
+	auto state = std::make_shared<bulk_state<Func>>(n, &func);
+	size_t num_helpers = (std::min)(n, executor.concurrency()) - 1;
+	for (size_t i = 0; i < num_helpers; ++i) {
+		executor.submit([state]() { state->run(); });
+	}
+
+	state->run();
+	state->wait();
+}
+} // namespace detail
+
+// Runs tasks on the calling thread.
+struct inline_executor {
+	template <class Task>
+	void submit(Task task) {
+		task();
+	}
+
+	template <class Func>
+	void bulk(size_t n, Func func) {
+		for (size_t i = 0; i < n; ++i) {
+			func(i);
+		}
+	}
+
+	size_t concurrency() const {
+		return 1;
+	}
+};
+
+// A work-stealing thread pool.
+// Each worker owns a task queue. Tasks submitted from a worker go to its own
+// queue and are popped last in first out. Idle workers steal first in first
+// out from the others.
+struct work_stealing_pool {
+	// If num_threads is 0, uses std::thread::hardware_concurrency.
+	explicit work_stealing_pool(size_t num_threads = 0) {
+		if (num_threads == 0) {
+			num_threads = (std::max)(
+					size_t(std::thread::hardware_concurrency()), size_t(1));
+		}
+
+		_queues.reserve(num_threads);
+		for (size_t i = 0; i < num_threads; ++i) {
+			_queues.push_back(std::make_unique<queue>());
+		}
+
+		_threads.reserve(num_threads);
+		for (size_t i = 0; i < num_threads; ++i) {
+			_threads.emplace_back([this, i]() { work(i); });
+		}
+	}
+
+	work_stealing_pool(const work_stealing_pool&) = delete;
+	work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+
+	// Finishes queued tasks, then joins.
+	~work_stealing_pool() {
+		{
+			std::lock_guard<std::mutex> lock{ _sleep_mutex };
+			_stop = true;
+		}
+		_sleep_cv.notify_all();
+
+		for (std::thread& t : _threads) {
+			t.join();
+		}
+	}
+
+	template <class Task>
+	void submit(Task task) {
+		size_t queue_idx = current_worker() == this
+				? current_worker_idx()
+				: _next_queue.fetch_add(1, std::memory_order_relaxed)
+						% _queues.size();
+
+		{
+			queue& q = *_queues[queue_idx];
+			std::lock_guard<std::mutex> lock{ q.mutex };
+			q.tasks.push_back(std::function<void()>(std::move(task)));
+		}
+
+		_num_pending.fetch_add(1, std::memory_order_release);
+		{
+			// Don't miss a worker going to sleep.
+			std::lock_guard<std::mutex> lock{ _sleep_mutex };
+		}
+		_sleep_cv.notify_one();
+	}
+
+	template <class Func>
+	void bulk(size_t n, Func func) {
+		detail::bulk_with_submit(*this, n, func);
+	}
+
+	size_t concurrency() const {
+		return _threads.size();
+	}
+
+private:
+	struct queue {
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	static const work_stealing_pool*& current_worker() {
+		static thread_local const work_stealing_pool* pool = nullptr;
+		return pool;
+	}
+
+	static size_t& current_worker_idx() {
+		static thread_local size_t idx = 0;
+		return idx;
+	}
+
+	bool pop(size_t worker_idx, std::function<void()>* out) {
+		{
+			queue& q = *_queues[worker_idx];
+			std::lock_guard<std::mutex> lock{ q.mutex };
+			if (!q.tasks.empty()) {
+				*out = std::move(q.tasks.back());
+				q.tasks.pop_back();
+				return true;
+			}
+		}
+
+		for (size_t i = 1; i < _queues.size(); ++i) {
+			queue& q = *_queues[(worker_idx + i) % _queues.size()];
+			std::lock_guard<std::mutex> lock{ q.mutex };
+			if (!q.tasks.empty()) {
+				*out = std::move(q.tasks.front());
+				q.tasks.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void work(size_t worker_idx) {
+		current_worker() = this;
+		current_worker_idx() = worker_idx;
+
+		std::function<void()> task;
+		while (true) {
+			if (pop(worker_idx, &task)) {
+				_num_pending.fetch_sub(1, std::memory_order_relaxed);
+				task();
+				task = nullptr;
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock{ _sleep_mutex };
+			_sleep_cv.wait(lock, [this]() {
+				return _stop
+						|| _num_pending.load(std::memory_order_acquire) != 0;
+			});
+
+			if (_stop && _num_pending.load(std::memory_order_acquire) == 0) {
+				return;
+			}
+		}
+	}
+
+	std::vector<std::unique_ptr<queue>> _queues;
+	std::vector<std::thread> _threads;
+	std::atomic<size_t> _next_queue{ 0 };
+	std::atomic<size_t> _num_pending{ 0 };
+	std::mutex _sleep_mutex;
+	std::condition_variable _sleep_cv;
+	bool _stop = false;
+};
+
+// Adapts a thread pool which provides submit(task). Bulk is implemented with
+// submit, the calling thread participates.
+// concurrency is the pool's thread count.
+template <class Pool>
+struct executor_adapter {
+	executor_adapter(Pool* pool, size_t concurrency)
+			: _pool(pool)
+			, _concurrency((std::max)(concurrency, size_t(1))) {
+	}
+
+	template <class Task>
+	void submit(Task task) {
+		_pool->submit(std::move(task));
+	}
+
+	template <class Func>
+	void bulk(size_t n, Func func) {
+		detail::bulk_with_submit(*this, n, func);
+	}
+
+	size_t concurrency() const {
+		return _concurrency;
+	}
+
+private:
+	Pool* _pool;
+	size_t _concurrency;
+};
+
+template <class Pool>
+inline executor_adapter<Pool> make_executor_adapter(
+		Pool* pool, size_t concurrency) {
+	return executor_adapter<Pool>(pool, concurrency);
+}
+
+// The process-wide work_stealing_pool, used by the parallel apis called
+// without an executor. Created on first use, with
+// std::thread::hardware_concurrency threads.
+inline work_stealing_pool& default_executor() {
+	static work_stealing_pool pool;
+	return pool;
+}
+
+
+/*
+ Forest Functions
+*/
+
+// Forest apis traverse multiple roots in a single pass, with a single output.
+// Roots are provided as a range [first, last) of root iterators, for example
+// your top-level container's begin() and end().
+
+// Flat depth-first iteration of a forest. Roots are visited in order.
+// Reuses the same stack for all roots.
+// Executes func on each node.
+// CullPredicate accepts an iterator and returns true if the node and its
+// sub-tree should be culled.
+template <class FwdIt, class Func, class CullPredicate,
+		class StatePtr = const void>
+inline void for_each_depthfirst_forest(FwdIt first, FwdIt last, Func func,
+		CullPredicate cull_pred, StatePtr* state_ptr = nullptr) {
+	static_assert(
+			std::is_base_of<std::forward_iterator_tag,
+					typename std::iterator_traits<FwdIt>::iterator_category>::
+					value,
+			"for_each_depthfirst_forest : iterators must be at minimum "
+			"forward");
+
+	detail::flat_stack_t<FwdIt> stack;
+	for (; first != last; ++first) {
+		detail::for_each_depthfirst_flat(first, func, cull_pred, state_ptr,
+				&stack,
+				typename std::iterator_traits<FwdIt>::iterator_category{});
+	}
+}
+
+// Flat depth-first iteration of a forest. Roots are visited in order.
+// Reuses the same stack for all roots.
+// Executes func on each node.
+template <class FwdIt, class Func, class StatePtr = const void>
+inline void for_each_depthfirst_forest(
+		FwdIt first, FwdIt last, Func func, StatePtr* state_ptr = nullptr) {
+	static_assert(
+			std::is_base_of<std::forward_iterator_tag,
+					typename std::iterator_traits<FwdIt>::iterator_category>::
+					value,
+			"for_each_depthfirst_forest : iterators must be at minimum "
+			"forward");
+
+	detail::flat_stack_t<FwdIt> stack;
+	for (; first != last; ++first) {
+		detail::for_each_depthfirst_flat(first, func, state_ptr, &stack,
+				typename std::iterator_traits<FwdIt>::iterator_category{});
+	}
+}
+
+// Gathers a depth-first flat vector of a forest.
+// Every root's sub-tree is contiguous. If root_offsets isn't null, it is
+// filled with the boundaries of every root : root i's nodes are
+// [root_offsets[i], root_offsets[i + 1]). Culled roots have empty ranges.
+// CullPredicate is a predicate function which accepts an iterator, and returns
+// true if the provided node and its sub-tree should be culled.
+template <class FwdIt, class CullPredicate, class StatePtr = const void>
+inline void gather_depthfirst_forest(FwdIt first, FwdIt last,
+		CullPredicate cull_pred, std::vector<FwdIt>* out,
+		std::vector<size_t>* root_offsets, StatePtr* state_ptr = nullptr) {
+	static_assert(
+			std::is_base_of<std::forward_iterator_tag,
+					typename std::iterator_traits<FwdIt>::iterator_category>::
+					value,
+			"gather_depthfirst_forest : iterators must be at minimum forward");
+
+	out->clear();
+	if (root_offsets != nullptr) {
+		root_offsets->clear();
+	}
+
+	auto func = [&](FwdIt node) { out->push_back(node); };
+	detail::flat_stack_t<FwdIt> stack;
+	for (; first != last; ++first) {
+		if (root_offsets != nullptr) {
+			root_offsets->push_back(out->size());
+		}
+
+		detail::for_each_depthfirst_flat(first, func, cull_pred, state_ptr,
+				&stack,
+				typename std::iterator_traits<FwdIt>::iterator_category{});
+	}
+
+	if (root_offsets != nullptr) {
+		root_offsets->push_back(out->size());
+	}
+}
+
+// Gathers a depth-first flat vector of a forest.
+// Every root's sub-tree is contiguous. If root_offsets isn't null, it is
+// filled with the boundaries of every root : root i's nodes are
+// [root_offsets[i], root_offsets[i + 1]).
+template <class FwdIt, class StatePtr = const void>
+inline void gather_depthfirst_forest(FwdIt first, FwdIt last,
+		std::vector<FwdIt>* out, std::vector<size_t>* root_offsets,
+		StatePtr* state_ptr = nullptr) {
+	return gather_depthfirst_forest(
+			first, last, [](FwdIt) { return false; }, out, root_offsets,
+			state_ptr);
+}
+
+// Gathers a breadth-first flat vector of a forest.
+// The roots are the first breadth.
+// CullPredicate is a predicate function which accepts an iterator, and returns
+// true if the provided node and its sub-tree should be culled.
+template <class InputIt, class CullPredicate, class StatePtr = const void>
+inline void gather_breadthfirst_forest(InputIt first, InputIt last,
+		CullPredicate cull_pred, std::vector<InputIt>* out,
+		StatePtr* state_ptr = nullptr) {
+	out->clear();
+	for (; first != last; ++first) {
+		if (cull_pred(first)) {
+			continue;
+		}
+		out->push_back(first);
+	}
+
+	detail::expand_breadthfirst(cull_pred, out, state_ptr);
+}
+
+// Gathers a breadth-first flat vector of a forest.
+// The roots are the first breadth.
+template <class InputIt, class StatePtr = const void>
+inline void gather_breadthfirst_forest(InputIt first, InputIt last,
+		std::vector<InputIt>* out, StatePtr* state_ptr = nullptr) {
+	return gather_breadthfirst_forest(
+			first, last, [](InputIt) { return false; }, out, state_ptr);
+}
+
+// Gathers a breadth-first vector of vector of a forest. Sub vectors are the
+// breadths, the roots are the first breadth.
+// CullPredicate is a predicate function which accepts an iterator, and returns
+// true if the provided node and its sub-tree should be culled.
+template <class InputIt, class CullPredicate, class StatePtr = const void>
+inline void gather_breadthfirst_staged_forest(InputIt first, InputIt last,
+		CullPredicate cull_pred, std::vector<std::vector<InputIt>>* out,
+		StatePtr* state_ptr = nullptr) {
+	// Breadths are reused, keep out around to reuse its memory.
+	if (out->empty()) {
+		out->push_back({});
+	}
+
+	std::vector<InputIt>& roots = out->front();
+	roots.clear();
+	for (; first != last; ++first) {
+		if (cull_pred(first)) {
+			continue;
+		}
+		roots.push_back(first);
+	}
+
+	if (roots.empty()) {
+		out->clear();
+		return;
+	}
+
+	detail::expand_breadthfirst_staged(cull_pred, out, state_ptr);
+}
+
+// Gathers a breadth-first vector of vector of a forest. Sub vectors are the
+// breadths, the roots are the first breadth.
+template <class InputIt, class StatePtr = const void>
+inline void gather_breadthfirst_staged_forest(InputIt first, InputIt last,
+		std::vector<std::vector<InputIt>>* out, StatePtr* state_ptr = nullptr) {
+	return gather_breadthfirst_staged_forest(
+			first, last, [](InputIt) { return false; }, out, state_ptr);
+}
+
+// Multi-threaded gather_depthfirst_forest, runs on executor. Roots are split
+// in contiguous chunks, a few per thread. The output is identical to
+// gather_depthfirst_forest.
+// CullPredicate and children_range must be thread-safe.
+template <class Executor, class FwdIt, class CullPredicate,
+		class StatePtr = const void>
+inline void gather_depthfirst_forest_par(Executor& executor, FwdIt first,
+		FwdIt last, CullPredicate cull_pred, std::vector<FwdIt>* out,
+		std::vector<size_t>* root_offsets, StatePtr* state_ptr = nullptr) {
+	size_t num_roots = size_t(std::distance(first, last));
+
+	// More chunks than threads, to balance uneven trees.
+	size_t num_chunks = executor.concurrency() <= 1
+			? 1
+			: (std::min)(executor.concurrency() * 4, num_roots);
+
+	if (num_chunks <= 1) {
+		return gather_depthfirst_forest(
+				first, last, cull_pred, out, root_offsets, state_ptr);
+	}
+
+	// Split roots.
+	std::vector<FwdIt> chunk_firsts;
+	chunk_firsts.reserve(num_chunks + 1);
+	for (size_t i = 0; i < num_chunks; ++i) {
+		chunk_firsts.push_back(first);
+		size_t chunk_size = num_roots / num_chunks
+				+ (i < num_roots % num_chunks ? 1 : 0);
+		std::advance(first, chunk_size);
+	}
+	chunk_firsts.push_back(last);
+
+	std::vector<std::vector<FwdIt>> chunk_outs(num_chunks);
+	std::vector<std::vector<size_t>> chunk_offsets(num_chunks);
+	executor.bulk(num_chunks, [&](size_t i) {
+		gather_depthfirst_forest(chunk_firsts[i], chunk_firsts[i + 1],
+				cull_pred, &chunk_outs[i],
+				root_offsets == nullptr ? nullptr : &chunk_offsets[i],
+				state_ptr);
+	});
+
+	// Merge.
+	size_t total_size = 0;
+	for (const std::vector<FwdIt>& v : chunk_outs) {
+		total_size += v.size();
+	}
+
+	out->clear();
+	out->reserve(total_size);
+	if (root_offsets != nullptr) {
+		root_offsets->clear();
+		root_offsets->reserve(num_roots + 1);
+	}
+
+	for (size_t i = 0; i < num_chunks; ++i) {
+		if (root_offsets != nullptr) {
+			// Skip last offset, it is the next chunk's first.
+			for (size_t j = 0; j + 1 < chunk_offsets[i].size(); ++j) {
+				root_offsets->push_back(out->size() + chunk_offsets[i][j]);
+			}
+		}
+		out->insert(out->end(), chunk_outs[i].begin(), chunk_outs[i].end());
+	}
+
+	if (root_offsets != nullptr) {
+		root_offsets->push_back(out->size());
+	}
+}
+
+// Multi-threaded gather_depthfirst_forest, runs on executor. The output is
+// identical to gather_depthfirst_forest.
+// children_range must be thread-safe.
+template <class Executor, class FwdIt, class StatePtr = const void>
+inline void gather_depthfirst_forest_par(Executor& executor, FwdIt first,
+		FwdIt last, std::vector<FwdIt>* out, std::vector<size_t>* root_offsets,
+		StatePtr* state_ptr = nullptr) {
+	return gather_depthfirst_forest_par(
+			executor, first, last, [](FwdIt) { return false; }, out,
+			root_offsets, state_ptr);
+}
+
+// Multi-threaded gather_depthfirst_forest, runs on default_executor().
+// The output is identical to gather_depthfirst_forest.
+// CullPredicate and children_range must be thread-safe.
+template <class FwdIt, class CullPredicate, class StatePtr = const void>
+inline void gather_depthfirst_forest_par(FwdIt first, FwdIt last,
+		CullPredicate cull_pred, std::vector<FwdIt>* out,
+		std::vector<size_t>* root_offsets, StatePtr* state_ptr = nullptr) {
+	return gather_depthfirst_forest_par(default_executor(), first, last,
+			cull_pred, out, root_offsets, state_ptr);
+}
+
+// Multi-threaded gather_depthfirst_forest, runs on default_executor().
+// The output is identical to gather_depthfirst_forest.
+// children_range must be thread-safe.
+template <class FwdIt, class StatePtr = const void>
+inline void gather_depthfirst_forest_par(FwdIt first, FwdIt last,
+		std::vector<FwdIt>* out, std::vector<size_t>* root_offsets,
+		StatePtr* state_ptr = nullptr) {
+	return gather_depthfirst_forest_par(default_executor(), first, last, out,
+			root_offsets, state_ptr);
+}
+
+
+/*
+ Find Functions
+*/
+
+// Find functions stop as soon as a node matches.
+// UnaryPredicate accepts an iterator and returns true on a match.
+// Culled nodes and their sub-trees are never tested.
+
+namespace detail {
+// find_if_depthfirst, for a root which already passed cull_pred.
+template <class FwdIt, class UnaryPredicate, class CullPredicate,
+		class StatePtr>
+inline bool find_if_depthfirst_unculled(FwdIt root, UnaryPredicate& pred,
+		CullPredicate& cull_pred, FwdIt* out, StatePtr* state_ptr) {
+	// Same as the forward iterator for_each_depthfirst_flat, with an early
+	// exit. Children ranges are walked in order, no need to reverse them.
+	if (pred(root)) {
+		*out = root;
+		return true;
+	}
+
+	using fea::children_range;
+	std::vector<std::pair<FwdIt, FwdIt>> stack;
+	stack.push_back(children_range(root, state_ptr));
+
+	while (!stack.empty()) {
+		std::pair<FwdIt, FwdIt>& range = stack.back();
+
+		while (range.first != range.second && cull_pred(range.first)) {
+			++range.first;
+		}
+
+		if (range.first == range.second) {
+			stack.pop_back();
+			continue;
+		}
+
+		FwdIt current_node = range.first++;
+		if (pred(current_node)) {
+			*out = current_node;
+			return true;
+		}
+
+		// Invalidates range.
+		stack.push_back(children_range(current_node, state_ptr));
+	}
+
+	return false;
+}
+} // namespace detail
+
+// Finds the first node matching pred, in depth-first order.
+// Returns true if found, and assigns the node to out.
+// CullPredicate accepts an iterator and returns true if the node and its
+// sub-tree should be culled.
+template <class FwdIt, class UnaryPredicate, class CullPredicate,
+		class StatePtr = const void>
+inline bool find_if_depthfirst(FwdIt root, UnaryPredicate pred,
+		CullPredicate cull_pred, FwdIt* out, StatePtr* state_ptr = nullptr) {
+	static_assert(
+			std::is_base_of<std::forward_iterator_tag,
+					typename std::iterator_traits<FwdIt>::iterator_category>::
+					value,
+			"find_if_depthfirst : iterators must be at minimum forward");
+
+	if (cull_pred(root)) {
+		return false;
+	}
+	return detail::find_if_depthfirst_unculled(
+			root, pred, cull_pred, out, state_ptr);
+}
+
+// Finds the first node matching pred, in depth-first order.
+// Returns true if found, and assigns the node to out.
+template <class FwdIt, class UnaryPredicate, class StatePtr = const void>
+inline bool find_if_depthfirst(FwdIt root, UnaryPredicate pred, FwdIt* out,
+		StatePtr* state_ptr = nullptr) {
+	return find_if_depthfirst(
+			root, pred, [](FwdIt) { return false; }, out, state_ptr);
+}
+
+// Finds the first node matching pred, in breadth-first order.
+// Returns true if found, and assigns the node to out.
+// CullPredicate accepts an iterator and returns true if the node and its
+// sub-tree should be culled.
+template <class InputIt, class UnaryPredicate, class CullPredicate,
+		class StatePtr = const void>
+inline bool find_if_breadthfirst(InputIt root, UnaryPredicate pred,
+		CullPredicate cull_pred, InputIt* out, StatePtr* state_ptr = nullptr) {
+	if (cull_pred(root)) {
+		return false;
+	}
+
+	// Nodes are tested when enqueued, which is breadth-first order.
+	if (pred(root)) {
+		*out = root;
+		return true;
+	}
+
+	std::vector<InputIt> queue;
+	queue.push_back(root);
+
+	for (size_t i = 0; i < queue.size(); ++i) {
+		using fea::children_range;
+		std::pair<InputIt, InputIt> range
+				= children_range(queue[i], state_ptr);
+
+		for (InputIt it = range.first; it != range.second; ++it) {
+			if (cull_pred(it)) {
+				continue;
+			}
+
+			if (pred(it)) {
+				*out = it;
+				return true;
+			}
+			queue.push_back(it);
+		}
+	}
+
+	return false;
+}
+
+// Finds the first node matching pred, in breadth-first order.
+// Returns true if found, and assigns the node to out.
+template <class InputIt, class UnaryPredicate, class StatePtr = const void>
+inline bool find_if_breadthfirst(InputIt root, UnaryPredicate pred,
+		InputIt* out, StatePtr* state_ptr = nullptr) {
+	return find_if_breadthfirst(
+			root, pred, [](InputIt) { return false; }, out, state_ptr);
+}
+
+// Returns true if any node matches pred.
+// CullPredicate accepts an iterator and returns true if the node and its
+// sub-tree should be culled.
+template <class FwdIt, class UnaryPredicate, class CullPredicate,
+		class StatePtr = const void>
+inline bool any_of(FwdIt root, UnaryPredicate pred, CullPredicate cull_pred,
+		StatePtr* state_ptr = nullptr) {
+	FwdIt found;
+	return find_if_depthfirst(root, pred, cull_pred, &found, state_ptr);
+}
+
+// Returns true if any node matches pred.
+template <class FwdIt, class UnaryPredicate, class StatePtr = const void>
+inline bool any_of(
+		FwdIt root, UnaryPredicate pred, StatePtr* state_ptr = nullptr) {
+	return any_of(root, pred, [](FwdIt) { return false; }, state_ptr);
+}
+
+namespace detail {
+// make_find_tasks stops splitting at this depth. Deep and narrow trees are
+// searched as a few sub-tree tasks, instead of walking them serially first.
+constexpr size_t find_max_split_depth = 32;
+
+// Splits the tree in sub-tree tasks, in depth-first order. Processing the
+// tasks in order is a depth-first traversal of the unsearched nodes.
+// Expands breadth-first until a breadth is min_tasks wide, or
+// find_max_split_depth deep. Expanded nodes are tested against pred, task
+// roots are not. Each node is culled once, task roots already passed
+// cull_pred.
+// Returns true if an expanded node matched, and assigns it to match. If
+// ordered, tasks hold the nodes which precede it in depth-first order.
+// Otherwise, tasks are empty.
+template <class FwdIt, class UnaryPredicate, class CullPredicate,
+		class StatePtr>
+inline bool make_find_tasks(FwdIt root, UnaryPredicate& pred,
+		CullPredicate& cull_pred, size_t min_tasks, bool ordered,
+		StatePtr* state_ptr, std::vector<FwdIt>* out, FwdIt* match) {
+	out->clear();
+	if (cull_pred(root)) {
+		return false;
+	}
+
+	std::vector<FwdIt> breadth{ root };
+	std::vector<FwdIt> next_breadth;
+	for (size_t depth = 0;
+			breadth.size() < min_tasks && depth < find_max_split_depth;
+			++depth) {
+		next_breadth.clear();
+
+		for (FwdIt node : breadth) {
+			if (pred(node)) {
+				*match = node;
+				if (ordered) {
+					// Children of the preceding nodes, in depth-first order.
+					out->swap(next_breadth);
+				}
+				return true;
+			}
+
+			using fea::children_range;
+			std::pair<FwdIt, FwdIt> range = children_range(node, state_ptr);
+			for (; range.first != range.second; ++range.first) {
+				if (!cull_pred(range.first)) {
+					next_breadth.push_back(range.first);
+				}
+			}
+		}
+
+		if (next_breadth.empty()) {
+			// Every node was tested.
+			return false;
+		}
+		breadth.swap(next_breadth);
+	}
+
+	// A breadth's order is depth-first order, for its nodes.
+	out->swap(breadth);
+	return false;
+}
+} // namespace detail
+
+// Multi-threaded find_if_depthfirst, runs on executor.
+// The tree is split in sub-tree tasks, which share an atomic cancellation
+// flag and stop early once a match is found. Nodes above the tasks are tested
+// while splitting.
+// If ordered is true, returns the first match in depth-first order, like
+// find_if_depthfirst. Tasks are only cancelled if they come after the best
+// match. Otherwise, returns any match.
+// UnaryPredicate, CullPredicate and children_range must be thread-safe.
+template <class Executor, class FwdIt, class UnaryPredicate,
+		class CullPredicate, class StatePtr = const void>
+inline bool find_if_depthfirst_par(Executor& executor, FwdIt root,
+		UnaryPredicate pred, CullPredicate cull_pred, FwdIt* out,
+		StatePtr* state_ptr = nullptr, bool ordered = true) {
+	if (executor.concurrency() <= 1) {
+		return find_if_depthfirst(root, pred, cull_pred, out, state_ptr);
+	}
+
+	std::vector<FwdIt> tasks;
+	FwdIt match{};
+	bool matched = detail::make_find_tasks(root, pred, cull_pred,
+			executor.concurrency() * 8, ordered, state_ptr, &tasks, &match);
+	if (matched && tasks.empty()) {
+		*out = match;
+		return true;
+	}
+	if (tasks.empty()) {
+		return false;
+	}
+
+	constexpr size_t not_found = (std::numeric_limits<size_t>::max)();
+
+	// The task index of the best match, doubles as cancellation flag.
+	// A match found while splitting comes after every task.
+	std::atomic<size_t> best_task{ matched ? tasks.size() : not_found };
+	std::vector<FwdIt> results(tasks.size() + 1);
+	results.back() = match;
+
+	auto cancelled = [&](size_t task_idx) {
+		size_t best = best_task.load(std::memory_order_relaxed);
+		return ordered ? best < task_idx : best != not_found;
+	};
+
+	executor.bulk(tasks.size(), [&](size_t task_idx) {
+		if (cancelled(task_idx)) {
+			return;
+		}
+
+		// Check for cancellation while searching.
+		bool stopped = false;
+		auto cancellable_pred = [&](FwdIt node) {
+			if (cancelled(task_idx)) {
+				stopped = true;
+				return true;
+			}
+			return pred(node);
+		};
+		bool found = detail::find_if_depthfirst_unculled(tasks[task_idx],
+				cancellable_pred, cull_pred, &results[task_idx], state_ptr);
+		if (!found || stopped) {
+			return;
+		}
+
+		size_t best = best_task.load(std::memory_order_relaxed);
+		while (task_idx < best
+				&& !best_task.compare_exchange_weak(
+						best, task_idx, std::memory_order_relaxed)) {
+		}
+	});
+
+	size_t best = best_task.load();
+	if (best == not_found) {
+		return false;
+	}
+
+	*out = results[best];
+	return true;
+}
+
+// Multi-threaded find_if_depthfirst, runs on executor.
+// If ordered is true, returns the first match in depth-first order, like
+// find_if_depthfirst. Otherwise, returns any match.
+// UnaryPredicate and children_range must be thread-safe.
+template <class Executor, class FwdIt, class UnaryPredicate,
+		class StatePtr = const void>
+inline bool find_if_depthfirst_par(Executor& executor, FwdIt root,
+		UnaryPredicate pred, FwdIt* out, StatePtr* state_ptr = nullptr,
+		bool ordered = true) {
+	return find_if_depthfirst_par(
+			executor, root, pred, [](FwdIt) { return false; }, out, state_ptr,
+			ordered);
+}
+
+// Multi-threaded find_if_breadthfirst, runs on executor.
+// Breadths are searched one after the other, each breadth's nodes are split in
+// contiguous chunks. Chunks share an atomic cancellation flag and stop early
+// once a preceding chunk found a match.
+// Returns the first match in breadth-first order, like find_if_breadthfirst.
+// UnaryPredicate, CullPredicate and children_range must be thread-safe.
+template <class Executor, class FwdIt, class UnaryPredicate,
+		class CullPredicate, class StatePtr = const void>
+inline bool find_if_breadthfirst_par(Executor& executor, FwdIt root,
+		UnaryPredicate pred, CullPredicate cull_pred, FwdIt* out,
+		StatePtr* state_ptr = nullptr) {
+	if (executor.concurrency() <= 1) {
+		return find_if_breadthfirst(root, pred, cull_pred, out, state_ptr);
+	}
+
+	if (cull_pred(root)) {
+		return false;
+	}
+
+	if (pred(root)) {
+		*out = root;
+		return true;
+	}
+
+	constexpr size_t not_found = (std::numeric_limits<size_t>::max)();
+	size_t max_chunks = executor.concurrency() * 4;
+
+	std::vector<FwdIt> breadth{ root };
+	std::vector<std::vector<FwdIt>> chunk_outs;
+	std::vector<FwdIt> results;
+
+	while (!breadth.empty()) {
+		size_t num_chunks = (std::min)(max_chunks, breadth.size());
+		chunk_outs.resize(num_chunks);
+		results.resize(num_chunks);
+
+		// The chunk index of the best match, doubles as cancellation flag.
+		std::atomic<size_t> best_chunk{ not_found };
+
+		executor.bulk(num_chunks, [&](size_t chunk_idx) {
+			std::vector<FwdIt>& chunk_out = chunk_outs[chunk_idx];
+			chunk_out.clear();
+
+			size_t first = breadth.size() * chunk_idx / num_chunks;
+			size_t last = breadth.size() * (chunk_idx + 1) / num_chunks;
+			for (size_t i = first; i < last; ++i) {
+				if (best_chunk.load(std::memory_order_relaxed) < chunk_idx) {
+					return;
+				}
+
+				// Nodes are tested when enqueued, like find_if_breadthfirst.
+				using fea::children_range;
+				std::pair<FwdIt, FwdIt> range
+						= children_range(breadth[i], state_ptr);
+				for (; range.first != range.second; ++range.first) {
+					if (cull_pred(range.first)) {
+						continue;
+					}
+
+					if (!pred(range.first)) {
+						chunk_out.push_back(range.first);
+						continue;
+					}
+
+					results[chunk_idx] = range.first;
+					size_t best = best_chunk.load(std::memory_order_relaxed);
+					while (chunk_idx < best
+							&& !best_chunk.compare_exchange_weak(best,
+									chunk_idx, std::memory_order_relaxed)) {
+					}
+					return;
+				}
+			}
+		});
+
+		size_t best = best_chunk.load();
+		if (best != not_found) {
+			*out = results[best];
+			return true;
+		}
+
+		// Chunks are contiguous, concatenating them keeps breadth order.
+		breadth.clear();
+		for (const std::vector<FwdIt>& chunk_out : chunk_outs) {
+			breadth.insert(breadth.end(), chunk_out.begin(), chunk_out.end());
+		}
+	}
+
+	return false;
+}
+
+// Multi-threaded find_if_breadthfirst, runs on executor.
+// Returns the first match in breadth-first order, like find_if_breadthfirst.
+// UnaryPredicate and children_range must be thread-safe.
+template <class Executor, class FwdIt, class UnaryPredicate,
+		class StatePtr = const void,
+		std::enable_if_t<detail::is_executor<Executor>::value, int> = 0>
+inline bool find_if_breadthfirst_par(Executor& executor, FwdIt root,
+		UnaryPredicate pred, FwdIt* out, StatePtr* state_ptr = nullptr) {
+	return find_if_breadthfirst_par(
+			executor, root, pred, [](FwdIt) { return false; }, out, state_ptr);
+}
+
+// Multi-threaded find_if_depthfirst, runs on default_executor().
+// If ordered is true, returns the first match in depth-first order, like
+// find_if_depthfirst. Otherwise, returns any match.
+// UnaryPredicate, CullPredicate and children_range must be thread-safe.
+template <class FwdIt, class UnaryPredicate, class CullPredicate,
+		class StatePtr = const void,
+		std::enable_if_t<!detail::is_executor<FwdIt>::value, int> = 0>
+inline bool find_if_depthfirst_par(FwdIt root, UnaryPredicate pred,
+		CullPredicate cull_pred, FwdIt* out, StatePtr* state_ptr = nullptr,
+		bool ordered = true) {
+	return find_if_depthfirst_par(default_executor(), root, pred, cull_pred,
+			out, state_ptr, ordered);
+}
+
+// Multi-threaded find_if_depthfirst, runs on default_executor().
+// If ordered is true, returns the first match in depth-first order, like
+// find_if_depthfirst. Otherwise, returns any match.
+// UnaryPredicate and children_range must be thread-safe.
+template <class FwdIt, class UnaryPredicate, class StatePtr = const void,
+		std::enable_if_t<!detail::is_executor<FwdIt>::value, int> = 0>
+inline bool find_if_depthfirst_par(FwdIt root, UnaryPredicate pred,
+		FwdIt* out, StatePtr* state_ptr = nullptr, bool ordered = true) {
+	return find_if_depthfirst_par(
+			default_executor(), root, pred, out, state_ptr, ordered);
+}
+
+// Multi-threaded find_if_breadthfirst, runs on default_executor().
+// Returns the first match in breadth-first order, like find_if_breadthfirst.
+// UnaryPredicate, CullPredicate and children_range must be thread-safe.
+template <class FwdIt, class UnaryPredicate, class CullPredicate,
+		class StatePtr = const void,
+		std::enable_if_t<!detail::is_executor<FwdIt>::value, int> = 0>
+inline bool find_if_breadthfirst_par(FwdIt root, UnaryPredicate pred,
+		CullPredicate cull_pred, FwdIt* out, StatePtr* state_ptr = nullptr) {
+	return find_if_breadthfirst_par(
+			default_executor(), root, pred, cull_pred, out, state_ptr);
+}
+
+// Multi-threaded find_if_breadthfirst, runs on default_executor().
+// Returns the first match in breadth-first order, like find_if_breadthfirst.
+// UnaryPredicate and children_range must be thread-safe.
+template <class FwdIt, class UnaryPredicate, class StatePtr = const void,
+		std::enable_if_t<!detail::is_executor<FwdIt>::value, int> = 0>
+inline bool find_if_breadthfirst_par(FwdIt root, UnaryPredicate pred,
+		FwdIt* out, StatePtr* state_ptr = nullptr) {
+	return find_if_breadthfirst_par(
+			default_executor(), root, pred, out, state_ptr);
+}
+
+// Multi-threaded any_of, runs on executor. Tasks stop as soon as any match is
+// found.
+// UnaryPredicate, CullPredicate and children_range must be thread-safe.
+template <class Executor, class FwdIt, class UnaryPredicate,
+		class CullPredicate, class StatePtr = const void,
+		std::enable_if_t<detail::is_executor<Executor>::value, int> = 0>
+inline bool any_of_par(Executor& executor, FwdIt root, UnaryPredicate pred,
+		CullPredicate cull_pred, StatePtr* state_ptr = nullptr) {
+	FwdIt found;
+	return find_if_depthfirst_par(
+			executor, root, pred, cull_pred, &found, state_ptr, false);
+}
+
+// Multi-threaded any_of, runs on executor. Tasks stop as soon as any match is
+// found.
+// UnaryPredicate and children_range must be thread-safe.
+template <class Executor, class FwdIt, class UnaryPredicate,
+		class StatePtr = const void,
+		std::enable_if_t<detail::is_executor<Executor>::value, int> = 0>
+inline bool any_of_par(Executor& executor, FwdIt root, UnaryPredicate pred,
+		StatePtr* state_ptr = nullptr) {
+	return any_of_par(
+			executor, root, pred, [](FwdIt) { return false; }, state_ptr);
+}
+
+// Multi-threaded any_of, runs on default_executor(). Tasks stop as soon as
+// any match is found.
+// UnaryPredicate, CullPredicate and children_range must be thread-safe.
+template <class FwdIt, class UnaryPredicate, class CullPredicate,
+		class StatePtr = const void,
+		std::enable_if_t<!detail::is_executor<FwdIt>::value, int> = 0>
+inline bool any_of_par(FwdIt root, UnaryPredicate pred,
+		CullPredicate cull_pred, StatePtr* state_ptr = nullptr) {
+	return any_of_par(default_executor(), root, pred, cull_pred, state_ptr);
+}
+
+// Multi-threaded any_of, runs on default_executor(). Tasks stop as soon as
+// any match is found.
+// UnaryPredicate and children_range must be thread-safe.
+template <class FwdIt, class UnaryPredicate, class StatePtr = const void,
+		std::enable_if_t<!detail::is_executor<FwdIt>::value, int> = 0>
+inline bool any_of_par(
+		FwdIt root, UnaryPredicate pred, StatePtr* state_ptr = nullptr) {
+	return any_of_par(default_executor(), root, pred, state_ptr);
+}
+
+/*
+ Best-First Functions
+*/
+
+// A d-ary min heap. top() is the smallest element according to Compare.
+// Wider nodes make the heap shallower, and the children of a node share
+// cache lines. Keep it around to reuse its memory.
+template <class T, class Compare = std::less<T>, size_t D = 4>
+struct dary_heap {
+	static_assert(D >= 2, "dary_heap : arity must be at least 2");
+
+	dary_heap(Compare comp = Compare{})
+			: _comp(comp) {
+	}
+
+	const T& top() const {
+		return _data.front();
+	}
+
+	bool empty() const {
+		return _data.empty();
+	}
+
+	size_t size() const {
+		return _data.size();
+	}
+
+	void reserve(size_t new_cap) {
+		_data.reserve(new_cap);
+	}
+
+	// Keeps capacity.
+	void clear() {
+		_data.clear();
+	}
+
+	void push(T value) {
+		size_t idx = _data.size();
+		_data.push_back(std::move(value));
+
+		// Sift up.
+		T moving = std::move(_data[idx]);
+		while (idx != 0) {
+			size_t parent = (idx - 1) / D;
+			if (!_comp(moving, _data[parent])) {
+				break;
+			}
+			_data[idx] = std::move(_data[parent]);
+			idx = parent;
+		}
+		_data[idx] = std::move(moving);
+	}
+
+	void pop() {
+		T moving = std::move(_data.back());
+		_data.pop_back();
+		if (_data.empty()) {
+			return;
+		}
+
+		// Sift down.
+		size_t idx = 0;
+		const size_t size = _data.size();
+		while (true) {
+			size_t first_child = idx * D + 1;
+			if (first_child >= size) {
+				break;
+			}
+
+			size_t last_child = (std::min)(first_child + D, size);
+			size_t min_child = first_child;
+			for (size_t c = first_child + 1; c < last_child; ++c) {
+				if (_comp(_data[c], _data[min_child])) {
+					min_child = c;
+				}
+			}
+
+			if (!_comp(_data[min_child], moving)) {
+				break;
+			}
+			_data[idx] = std::move(_data[min_child]);
+			idx = min_child;
+		}
+		_data[idx] = std::move(moving);
+	}
+
+private:
+	std::vector<T> _data;
+	Compare _comp;
+};
+
+namespace detail {
+template <class FwdIt, class Priority>
+struct bestfirst_entry {
+	Priority priority;
+	FwdIt node;
+};
+
+struct bestfirst_compare {
+	template <class Entry>
+	bool operator()(const Entry& lhs, const Entry& rhs) const {
+		return lhs.priority < rhs.priority;
+	}
+};
+
+// Calls func, returns false if it asked to stop.
+template <class Func, class FwdIt>
+inline bool call_continue(Func& func, FwdIt it, std::true_type /*void*/) {
+	func(it);
+	return true;
+}
+
+template <class Func, class FwdIt>
+inline bool call_continue(Func& func, FwdIt it, std::false_type /*bool*/) {
+	return bool(func(it));
+}
+} // namespace detail
+
+// The heap used by for_each_bestfirst, provide it to reuse its memory.
+template <class FwdIt, class Priority>
+using bestfirst_heap = dary_heap<detail::bestfirst_entry<FwdIt, Priority>,
+		detail::bestfirst_compare>;
+
+// Best-first iteration.
+// Expands the node with the lowest priority first. For nearest neighbour
+// queries, return the distance to the node's bounds.
+// Starts at the provided node.
+// PriorityFunc accepts an iterator and returns its priority, a type with
+// operator<.
+// Executes func on each node. If func returns a bool, returning false stops
+// the traversal.
+// CullPredicate accepts an iterator and returns true if the node and its
+// sub-tree should be culled. It is checked when a node is pushed, and again
+// when it is popped, so queries may prune with bounds found in the meantime.
+// The heap is provided so it may be reused between calls.
+template <class FwdIt, class PriorityFunc, class Func, class CullPredicate,
+		class Priority, class StatePtr = const void>
+inline void for_each_bestfirst(FwdIt root, PriorityFunc priority_fn, Func func,
+		CullPredicate cull_pred, bestfirst_heap<FwdIt, Priority>* heap,
+		StatePtr* state_ptr = nullptr) {
+	using returns_void = typename std::is_void<decltype(func(root))>::type;
+
+	heap->clear();
+	if (cull_pred(root)) {
+		return;
+	}
+	heap->push({ Priority(priority_fn(root)), root });
+
+	while (!heap->empty()) {
+		FwdIt current_node = heap->top().node;
+		heap->pop();
+
+		if (cull_pred(current_node)) {
+			continue;
+		}
+
+		if (!detail::call_continue(func, current_node, returns_void{})) {
+			heap->clear();
+			return;
+		}
+
+		using fea::children_range;
+		std::pair<FwdIt, FwdIt> range
+				= children_range(current_node, state_ptr);
+		for (; range.first != range.second; ++range.first) {
+			if (cull_pred(range.first)) {
+				continue;
+			}
+			heap->push({ Priority(priority_fn(range.first)), range.first });
+		}
+	}
+}
+
+// Best-first iteration.
+// Expands the node with the lowest priority first. For nearest neighbour
+// queries, return the distance to the node's bounds.
+// Starts at the provided node.
+// PriorityFunc accepts an iterator and returns its priority, a type with
+// operator<.
+// Executes func on each node. If func returns a bool, returning false stops
+// the traversal.
+// CullPredicate accepts an iterator and returns true if the node and its
+// sub-tree should be culled. It is checked when a node is pushed, and again
+// when it is popped, so queries may prune with bounds found in the meantime.
+template <class FwdIt, class PriorityFunc, class Func, class CullPredicate,
+		class StatePtr = const void>
+inline void for_each_bestfirst(FwdIt root, PriorityFunc priority_fn, Func func,
+		CullPredicate cull_pred, StatePtr* state_ptr = nullptr) {
+	bestfirst_heap<FwdIt, std::decay_t<decltype(priority_fn(root))>> heap;
+	return for_each_bestfirst(
+			root, priority_fn, func, cull_pred, &heap, state_ptr);
+}
+
+// Best-first iteration.
+// Expands the node with the lowest priority first.
+// Starts at the provided node.
+// PriorityFunc accepts an iterator and returns its priority, a type with
+// operator<.
+// Executes func on each node. If func returns a bool, returning false stops
+// the traversal.
+template <class FwdIt, class PriorityFunc, class Func,
+		class StatePtr = const void>
+inline void for_each_bestfirst(FwdIt root, PriorityFunc priority_fn, Func func,
+		StatePtr* state_ptr = nullptr) {
+	return for_each_bestfirst(
+			root, priority_fn, func, [](FwdIt) { return false; }, state_ptr);
+}
+
+
+/*
+ Index Functions
+*/
+
+// Index apis work on trees addressed by integer indices, for example nodes
+// stored in a vector. Children are provided by children_indices.
+// Indices are output as uint32_t, use them directly in your arrays.
+// CullPredicate accepts a uint32_t index.
+
+namespace detail {
+template <class Idx>
+inline bool is_empty_index(Idx idx) {
+	return idx == (std::numeric_limits<Idx>::max)();
+}
+
+// Indices are output as uint32_t, wider index types must fit.
+template <class Idx>
+inline uint32_t to_index(Idx idx) {
+	assert(size_t(idx) <= (std::numeric_limits<uint32_t>::max)());
+	return uint32_t(idx);
+}
+} // namespace detail
+
+// Flat depth-first iteration on indices.
+// Starts at the provided index.
+// Executes func on each index.
+// CullPredicate accepts an index and returns true if the node and its
+// sub-tree should be culled.
+template <class Func, class CullPredicate, class StatePtr>
+inline void for_each_depthfirst_indices(uint32_t root, Func func,
+		CullPredicate cull_pred, StatePtr* state_ptr) {
+	if (cull_pred(root)) {
+		return;
+	}
+
+	std::vector<uint32_t> stack;
+	stack.push_back(root);
+
+	while (!stack.empty()) {
+		uint32_t current_idx = stack.back();
+		stack.pop_back();
+		func(current_idx);
+
+		using fea::children_indices;
+		auto range = children_indices(current_idx, state_ptr);
+		static_assert(
+				std::is_base_of<std::bidirectional_iterator_tag,
+						typename std::iterator_traits<decltype(
+								range.first)>::iterator_category>::value,
+				"for_each_depthfirst_indices : children_indices iterators "
+				"must be at minimum bidirectional");
+
+		// Enqueue in the stack back to front.
+		while (range.second != range.first) {
+			--range.second;
+			if (detail::is_empty_index(*range.second)) {
+				continue;
+			}
+
+			uint32_t idx = detail::to_index(*range.second);
+			if (cull_pred(idx)) {
+				continue;
+			}
+			stack.push_back(idx);
+		}
+	}
+}
+
+// Flat depth-first iteration on indices.
+// Starts at the provided index.
+// Executes func on each index.
+template <class Func, class StatePtr>
+inline void for_each_depthfirst_indices(
+		uint32_t root, Func func, StatePtr* state_ptr) {
+	return for_each_depthfirst_indices(
+			root, func, [](uint32_t) { return false; }, state_ptr);
+}
+
+// Gathers a depth-first flat vector of indices.
+// Starts at the provided index.
+// CullPredicate is a predicate function which accepts an index, and returns
+// true if the provided node and its sub-tree should be culled.
+template <class CullPredicate, class StatePtr>
+inline void gather_depthfirst_indices(uint32_t root, CullPredicate cull_pred,
+		std::vector<uint32_t>* out, StatePtr* state_ptr) {
+	out->clear();
+
+	return for_each_depthfirst_indices(
+			root, [&](uint32_t idx) { out->push_back(idx); }, cull_pred,
+			state_ptr);
+}
+
+// Gathers a depth-first flat vector of indices.
+// Starts at the provided index.
+template <class StatePtr>
+inline void gather_depthfirst_indices(
+		uint32_t root, std::vector<uint32_t>* out, StatePtr* state_ptr) {
+	return gather_depthfirst_indices(
+			root, [](uint32_t) { return false; }, out, state_ptr);
+}
+
+// Gathers a breadth-first flat vector of indices.
+// Starts at the provided index.
+// CullPredicate is a predicate function which accepts an index, and returns
+// true if the provided node and its sub-tree should be culled.
+template <class CullPredicate, class StatePtr>
+inline void gather_breadthfirst_indices(uint32_t root, CullPredicate cull_pred,
+		std::vector<uint32_t>* out, StatePtr* state_ptr) {
+	out->clear();
+	if (cull_pred(root)) {
+		return;
+	}
+
+	out->push_back(root);
+
+	for (size_t i = 0; i < out->size(); ++i) {
+		using fea::children_indices;
+		auto range = children_indices((*out)[i], state_ptr);
+
+		for (auto it = range.first; it != range.second; ++it) {
+			if (detail::is_empty_index(*it)) {
+				continue;
+			}
+
+			uint32_t idx = detail::to_index(*it);
+			if (cull_pred(idx)) {
+				continue;
+			}
+			out->push_back(idx);
+		}
+	}
+}
+
+// Gathers a breadth-first flat vector of indices.
+// Starts at the provided index.
+template <class StatePtr>
+inline void gather_breadthfirst_indices(
+		uint32_t root, std::vector<uint32_t>* out, StatePtr* state_ptr) {
+	return gather_breadthfirst_indices(
+			root, [](uint32_t) { return false; }, out, state_ptr);
+}
+
+// Gathers a breadth-first vector of vector of indices. Sub vectors are the
+// breadths.
+// Starts at the provided index.
+// CullPredicate is a predicate function which accepts an index, and returns
+// true if the provided node and its sub-tree should be culled.
+template <class CullPredicate, class StatePtr>
+inline void gather_breadthfirst_staged_indices(uint32_t root,
+		CullPredicate cull_pred, std::vector<std::vector<uint32_t>>* out,
+		StatePtr* state_ptr) {
+	out->clear();
+	if (cull_pred(root)) {
+		return;
+	}
+
+	out->push_back({ root });
+
+	for (size_t i = 0; i < out->size(); ++i) {
+		std::vector<uint32_t> next_breadth;
+		// Expect at least as much as previous.
+		next_breadth.reserve((*out)[i].size());
+
+		for (uint32_t parent_idx : (*out)[i]) {
+			using fea::children_indices;
+			auto range = children_indices(parent_idx, state_ptr);
+
+			for (auto it = range.first; it != range.second; ++it) {
+				if (detail::is_empty_index(*it)) {
+					continue;
+				}
+
+				uint32_t idx = detail::to_index(*it);
+				if (cull_pred(idx)) {
+					continue;
+				}
+				next_breadth.push_back(idx);
+			}
+		}
+
+		if (!next_breadth.empty()) {
+			out->push_back(std::move(next_breadth));
+		}
+	}
+}
+
+// Gathers a breadth-first vector of vector of indices. Sub vectors are the
+// breadths.
+// Starts at the provided index.
+template <class StatePtr>
+inline void gather_breadthfirst_staged_indices(uint32_t root,
+		std::vector<std::vector<uint32_t>>* out, StatePtr* state_ptr) {
+	return gather_breadthfirst_staged_indices(
+			root, [](uint32_t) { return false; }, out, state_ptr);
+}
+
+
+/*
+ Visited Tracking
+*/
+
+// Visited sets are used to traverse DAGs, or any graph where nodes are shared.
+// Wrap your cull predicate with make_visited_cull, and pass it to a function
+// which tests each node's cull once : the for_each, gather and find functions.
+// Parallel functions require a thread-safe set, like visited_bitset_atomic.
+// Nodes are marked when first encountered, and culled on every subsequent
+// encounter, so each node is visited exactly once.
+// Shared sub-trees are only traversed once.
+// for_each_bestfirst tests culls on push and on pop, and
+// for_each_depthfirst_path culls paths. They do not support visited culls.
+// The stackless apis require a tree, they do not support shared nodes.
+
+namespace detail {
+// Finalizer from murmur3, addresses and ids have poor low bits.
+inline std::uint64_t mix64(std::uint64_t key) {
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdull;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ull;
+	key ^= key >> 33;
+	return key;
+}
+} // namespace detail
+
+// The default key used by visited_hashset. The address of the node pointed to
+// by the iterator.
+// If your iterators point to handles (pointers, ids, etc), provide a key
+// function which returns the handle's value instead.
+struct address_key {
+	template <class InputIt>
+	std::uintptr_t operator()(InputIt it) const {
+		return reinterpret_cast<std::uintptr_t>(std::addressof(*it));
+	}
+};
+
+// Dense visited set, for nodes with integer ids in [0, num_ids).
+// IdFunc accepts an iterator and returns the node id.
+template <class IdFunc>
+struct visited_bitset {
+	visited_bitset(size_t num_ids, IdFunc id_func)
+			: _bits((num_ids + 63) / 64, 0)
+			, _id_func(id_func) {
+	}
+
+	// Marks the node as visited. Returns true if it already was.
+	template <class InputIt>
+	bool test_and_set(InputIt it) {
+		size_t id = size_t(_id_func(it));
+		assert(id / 64 < _bits.size());
+		std::uint64_t mask = std::uint64_t(1) << (id % 64);
+		std::uint64_t& word = _bits[id / 64];
+
+		bool ret = (word & mask) != 0;
+		word |= mask;
+		return ret;
+	}
+
+	// Unmarks all nodes.
+	void clear() {
+		std::fill(_bits.begin(), _bits.end(), std::uint64_t(0));
+	}
+
+private:
+	std::vector<std::uint64_t> _bits;
+	IdFunc _id_func;
+};
+
+// Thread-safe dense visited set, for parallel traversals.
+// Nodes have integer ids in [0, num_ids).
+// IdFunc accepts an iterator and returns the node id.
+template <class IdFunc>
+struct visited_bitset_atomic {
+	visited_bitset_atomic(size_t num_ids, IdFunc id_func)
+			: _size((num_ids + 63) / 64)
+			, _bits(new std::atomic<std::uint64_t>[_size])
+			, _id_func(id_func) {
+		clear();
+	}
+
+	// Marks the node as visited. Returns true if it already was.
+	// Only one thread ever gets false for a given node.
+	template <class InputIt>
+	bool test_and_set(InputIt it) {
+		size_t id = size_t(_id_func(it));
+		assert(id / 64 < _size);
+		std::uint64_t mask = std::uint64_t(1) << (id % 64);
+		std::atomic<std::uint64_t>& word = _bits[id / 64];
+
+		// Cheap check first, avoids dirtying the cache line.
+		if ((word.load(std::memory_order_relaxed) & mask) != 0) {
+			return true;
+		}
+		return (word.fetch_or(mask, std::memory_order_relaxed) & mask) != 0;
+	}
+
+	// Unmarks all nodes. Not thread-safe.
+	void clear() {
+		for (size_t i = 0; i < _size; ++i) {
+			_bits[i].store(0, std::memory_order_relaxed);
+		}
+	}
+
+private:
+	size_t _size;
+	std::unique_ptr<std::atomic<std::uint64_t>[]> _bits;
+	IdFunc _id_func;
+};
+
+// Sparse visited set, for nodes without dense ids.
+// Open addressing (linear probing) hash set of keys.
+// KeyFunc accepts an iterator and returns an integer key which uniquely
+// identifies the node.
+template <class KeyFunc = address_key>
+struct visited_hashset {
+	visited_hashset(KeyFunc key_func = KeyFunc{}, size_t expected_size = 0)
+			: _key_func(key_func) {
+		size_t capacity = 16;
+		while (capacity < expected_size * 2) {
+			capacity *= 2;
+		}
+		_keys.assign(capacity, empty_key);
+	}
+
+	// Marks the node as visited. Returns true if it already was.
+	template <class InputIt>
+	bool test_and_set(InputIt it) {
+		std::uint64_t key = std::uint64_t(_key_func(it));
+
+		// The empty sentinel is stored out-of-band.
+		if (key == empty_key) {
+			bool ret = _has_empty_key;
+			_has_empty_key = true;
+			return ret;
+		}
+
+		size_t mask = _keys.size() - 1;
+		size_t idx = hash(key) & mask;
+		while (_keys[idx] != empty_key) {
+			if (_keys[idx] == key) {
+				return true;
+			}
+			idx = (idx + 1) & mask;
+		}
+
+		_keys[idx] = key;
+		++_size;
+
+		// Keep load factor under 1/2.
+		if (_size * 2 > _keys.size()) {
+			grow();
+		}
+		return false;
+	}
+
+	// Unmarks all nodes. Keeps capacity.
+	void clear() {
+		std::fill(_keys.begin(), _keys.end(), empty_key);
+		_size = 0;
+		_has_empty_key = false;
+	}
+
+private:
+	static constexpr std::uint64_t empty_key = ~std::uint64_t(0);
+
+	static size_t hash(std::uint64_t key) {
+		return size_t(detail::mix64(key));
+	}
+
+	void grow() {
+		std::vector<std::uint64_t> old_keys(_keys.size() * 2, empty_key);
+		old_keys.swap(_keys);
+
+		size_t mask = _keys.size() - 1;
+		for (std::uint64_t key : old_keys) {
+			if (key == empty_key) {
+				continue;
+			}
+
+			size_t idx = hash(key) & mask;
+			while (_keys[idx] != empty_key) {
+				idx = (idx + 1) & mask;
+			}
+			_keys[idx] = key;
+		}
+	}
+
+	std::vector<std::uint64_t> _keys;
+	size_t _size = 0;
+	bool _has_empty_key = false;
+	KeyFunc _key_func;
+};
+
+template <class KeyFunc>
+constexpr std::uint64_t visited_hashset<KeyFunc>::empty_key;
+
+template <class IdFunc>
+inline visited_bitset<IdFunc> make_visited_bitset(
+		size_t num_ids, IdFunc id_func) {
+	return visited_bitset<IdFunc>(num_ids, id_func);
+}
+
+template <class KeyFunc = address_key>
+inline visited_hashset<KeyFunc> make_visited_hashset(
+		KeyFunc key_func = KeyFunc{}, size_t expected_size = 0) {
+	return visited_hashset<KeyFunc>(key_func, expected_size);
+}
+
+// Returns a cull predicate which culls nodes already marked in visited, and
+// nodes culled by cull_pred. Unculled nodes are marked.
+// Visited must outlive the traversal.
+template <class Visited, class CullPredicate>
+inline auto make_visited_cull(Visited* visited, CullPredicate cull_pred) {
+	return [=](auto it) {
+		if (cull_pred(it)) {
+			return true;
+		}
+		return visited->test_and_set(it);
+	};
+}
+
+// Returns a cull predicate which culls nodes already marked in visited.
+// Unculled nodes are marked.
+// Visited must outlive the traversal.
+template <class Visited>
+inline auto make_visited_cull(Visited* visited) {
+	return [=](auto it) { return visited->test_and_set(it); };
+}
+
+
+/*
+ Subtree Hashing
+*/
+
+// Merkle hashes of sub-trees. A node's hash combines its own hash with its
+// children's hashes, in order. Two sub-trees with equal content and shape
+// hash equally, and any edit changes the hash of the node and its ancestors.
+//
+// Keep the hashes of your previous run, and cull with make_unchanged_cull to
+// only process what changed since.
+// Requires a tree, shared nodes are hashed once per parent.
+
+// Side table of sub-tree hashes, keyed by node.
+// KeyFunc accepts an iterator and returns an integer key which uniquely
+// identifies the node, and stays the same between runs.
+template <class KeyFunc = address_key>
+struct subtree_hashes {
+	subtree_hashes(KeyFunc key_func = KeyFunc{})
+			: _key_func(key_func) {
+	}
+
+	// Returns true and assigns the sub-tree hash of the node to out, if
+	// the node was hashed.
+	template <class InputIt>
+	bool find(InputIt it, std::uint64_t* out) const {
+		auto found = _hashes.find(std::uint64_t(_key_func(it)));
+		if (found == _hashes.end()) {
+			return false;
+		}
+		*out = found->second;
+		return true;
+	}
+
+	// Returns true if both tables hold the same hash for the node.
+	template <class InputIt>
+	bool unchanged(InputIt it, const subtree_hashes& previous) const {
+		std::uint64_t key = std::uint64_t(_key_func(it));
+		auto current_it = _hashes.find(key);
+		auto previous_it = previous._hashes.find(key);
+		return current_it != _hashes.end()
+				&& previous_it != previous._hashes.end()
+				&& current_it->second == previous_it->second;
+	}
+
+	// Assigns the sub-tree hash of the node.
+	template <class InputIt>
+	void set(InputIt it, std::uint64_t hash) {
+		_hashes[std::uint64_t(_key_func(it))] = hash;
+	}
+
+	size_t size() const {
+		return _hashes.size();
+	}
+
+	void reserve(size_t new_cap) {
+		_hashes.reserve(new_cap);
+	}
+
+	// Keeps capacity.
+	void clear() {
+		_hashes.clear();
+	}
+
+private:
+	std::unordered_map<std::uint64_t, std::uint64_t> _hashes;
+	KeyFunc _key_func;
+};
+
+// Computes the Merkle hash of every sub-tree starting at root, in a flat
+// bottom-up pass over the depth-first order. Fills out.
+// NodeHashFunc accepts an iterator and returns an integer hash of the node's
+// own content.
+template <class FwdIt, class NodeHashFunc, class KeyFunc,
+		class StatePtr = const void>
+inline void hash_subtrees(FwdIt root, NodeHashFunc node_hash_fn,
+		subtree_hashes<KeyFunc>* out, StatePtr* state_ptr = nullptr) {
+	std::vector<FwdIt> nodes;
+	gather_depthfirst_flat(root, &nodes, state_ptr);
+
+	// In depth-first order, a node's first child follows it, and each sibling
+	// follows the previous sibling's sub-tree. Going backwards, children are
+	// done before their parent.
+	std::vector<std::uint64_t> hashes(nodes.size());
+	std::vector<size_t> subtree_sizes(nodes.size());
+	for (size_t i = nodes.size(); i-- > 0;) {
+		std::uint64_t hash
+				= detail::mix64(std::uint64_t(node_hash_fn(nodes[i])));
+		size_t subtree_size = 1;
+
+		using fea::children_range;
+		std::pair<FwdIt, FwdIt> range = children_range(nodes[i], state_ptr);
+		for (; range.first != range.second; ++range.first) {
+			size_t child_idx = i + subtree_size;
+			// Order dependent combine, from boost.
+			hash ^= hashes[child_idx] + 0x9e3779b97f4a7c15ull + (hash << 6)
+					+ (hash >> 2);
+			subtree_size += subtree_sizes[child_idx];
+		}
+
+		hashes[i] = hash;
+		subtree_sizes[i] = subtree_size;
+	}
+
+	out->clear();
+	out->reserve(nodes.size());
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		out->set(nodes[i], hashes[i]);
+	}
+}
+
+// Computes the Merkle hash of every sub-tree starting at root, in a flat
+// bottom-up pass over the depth-first order. Nodes are keyed by address.
+// NodeHashFunc accepts an iterator and returns an integer hash of the node's
+// own content.
+template <class FwdIt, class NodeHashFunc, class StatePtr = const void>
+inline subtree_hashes<address_key> hash_subtrees(
+		FwdIt root, NodeHashFunc node_hash_fn, StatePtr* state_ptr = nullptr) {
+	subtree_hashes<address_key> ret;
+	hash_subtrees(root, node_hash_fn, &ret, state_ptr);
+	return ret;
+}
+
+// Returns a cull predicate which culls sub-trees with the same hash in
+// previous and current, and nodes culled by cull_pred.
+// The tables must outlive the traversal.
+template <class KeyFunc, class CullPredicate>
+inline auto make_unchanged_cull(const subtree_hashes<KeyFunc>* previous,
+		const subtree_hashes<KeyFunc>* current, CullPredicate cull_pred) {
+	return [=](auto it) {
+		return cull_pred(it) || current->unchanged(it, *previous);
+	};
+}
+
+// Returns a cull predicate which culls sub-trees with the same hash in
+// previous and current.
+// The tables must outlive the traversal.
+template <class KeyFunc>
+inline auto make_unchanged_cull(const subtree_hashes<KeyFunc>* previous,
+		const subtree_hashes<KeyFunc>* current) {
+	return [=](auto it) { return current->unchanged(it, *previous); };
+}
+
+
+/*
+ Sparse Slots
+*/
+
+// Nodes with fixed child slots, most of them empty (sparse voxel octrees for
+// example), may expose an occupancy bitmask instead of sentinel values. Use
+// sparse_slot_iterator as your node iterator. It iterates the set bits only,
+// empty slots are never visited, culled or passed to children_range.
+//
+// In your children_range specialization, return
+// make_sparse_slots_range(slots_begin, occupancy_mask).
+// Bit i of the mask is slot i.
+
+namespace detail {
+inline unsigned count_trailing_zeros(std::uint64_t mask) {
+#if defined(_MSC_VER)
+	unsigned long ret;
+#if defined(_WIN64)
+	_BitScanForward64(&ret, mask);
+#else
+	if (!_BitScanForward(&ret, std::uint32_t(mask))) {
+		_BitScanForward(&ret, std::uint32_t(mask >> 32));
+		ret += 32;
+	}
+#endif
+	return unsigned(ret);
+#else
+	return unsigned(__builtin_ctzll(mask));
+#endif
+}
+
+inline unsigned popcount(std::uint64_t mask) {
+#if defined(_MSC_VER)
+	unsigned ret = 0;
+	for (; mask != 0; mask &= mask - 1) {
+		++ret;
+	}
+	return ret;
+#else
+	return unsigned(__builtin_popcountll(mask));
+#endif
+}
+} // namespace detail
+
+// Iterates the occupied slots of [base, base + bits in Mask).
+// Dereferences to the underlying slot.
+template <class RandomIt, class Mask = std::uint32_t>
+struct sparse_slot_iterator {
+	static_assert(std::is_unsigned<Mask>::value
+					&& sizeof(Mask) <= sizeof(std::uint64_t),
+			"sparse_slot_iterator : mask must be an unsigned integer of at "
+			"most 64 bits");
+
+	using value_type = typename std::iterator_traits<RandomIt>::value_type;
+	using pointer = typename std::iterator_traits<RandomIt>::pointer;
+	using reference = typename std::iterator_traits<RandomIt>::reference;
+	using iterator_category = std::forward_iterator_tag;
+	using difference_type = std::ptrdiff_t;
+
+	sparse_slot_iterator() = default;
+	sparse_slot_iterator(RandomIt base, Mask mask)
+			: _base(base)
+			, _mask(mask) {
+	}
+
+	reference operator*() const {
+		return *slot_it();
+	}
+	pointer operator->() const {
+		return &*slot_it();
+	}
+
+	// Clears the lowest set bit.
+	sparse_slot_iterator& operator++() {
+		_mask &= Mask(_mask - 1);
+		return *this;
+	}
+	sparse_slot_iterator operator++(int) {
+		sparse_slot_iterator ret = *this;
+		++*this;
+		return ret;
+	}
+
+	bool operator==(const sparse_slot_iterator& other) const {
+		return _mask == other._mask && _base == other._base;
+	}
+	bool operator!=(const sparse_slot_iterator& other) const {
+		return !(*this == other);
+	}
+
+	// The current slot index.
+	size_t slot() const {
+		return detail::count_trailing_zeros(_mask);
+	}
+
+	// The underlying iterator of the current slot.
+	RandomIt slot_it() const {
+		return _base + slot();
+	}
+
+	// The number of remaining occupied slots, including this one.
+	size_t remaining() const {
+		return detail::popcount(_mask);
+	}
+
+private:
+	RandomIt _base{};
+	Mask _mask = 0;
+};
+
+// Returns the children range of a node with slots starting at base, and
+// occupancy mask.
+template <class RandomIt, class Mask>
+inline std::pair<sparse_slot_iterator<RandomIt, Mask>,
+		sparse_slot_iterator<RandomIt, Mask>>
+make_sparse_slots_range(RandomIt base, Mask mask) {
+	return { { base, mask }, { base, Mask(0) } };
+}
+
+// Returns an iterator to a single slot, use it as a traversal root.
+template <class RandomIt, class Mask = std::uint32_t>
+inline sparse_slot_iterator<RandomIt, Mask> make_sparse_slot_root(
+		RandomIt slot) {
+	return { slot, Mask(1) };
+}
 } // namespace fea
@@ -0,0 +1,309 @@
+#pragma once
+/*
+BSD 3-Clause License
+
+Copyright (c) 2019, Philippe Groarke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "fea_flat_recurse.hpp"
+
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace fea {
+/*
+ Flat Tree
+*/
+
+template <class T>
+struct flat_tree;
+
+// Iterates siblings. Returned by children_range, use the tree's root() to
+// start a traversal. No state pointer is required.
+template <class T, bool IsConst>
+struct flat_tree_iterator {
+	using tree_type = std::conditional_t<IsConst, const flat_tree<T>,
+			flat_tree<T>>;
+
+	using value_type = T;
+	using pointer = std::conditional_t<IsConst, const T*, T*>;
+	using reference = std::conditional_t<IsConst, const T&, T&>;
+	using iterator_category = std::forward_iterator_tag;
+	using difference_type = std::ptrdiff_t;
+
+	flat_tree_iterator() = default;
+	flat_tree_iterator(tree_type* tree, uint32_t idx)
+			: _tree(tree)
+			, _idx(idx) {
+	}
+
+	// iterator to const_iterator
+	template <bool C = IsConst, class = std::enable_if_t<C>>
+	flat_tree_iterator(const flat_tree_iterator<T, false>& other)
+			: _tree(other.tree())
+			, _idx(other.index()) {
+	}
+
+	reference operator*() const {
+		return (*_tree)[_idx];
+	}
+	pointer operator->() const {
+		return &(*_tree)[_idx];
+	}
+
+	flat_tree_iterator& operator++() {
+		_idx = _tree->next_sibling(_idx);
+		return *this;
+	}
+	flat_tree_iterator operator++(int) {
+		flat_tree_iterator ret = *this;
+		++*this;
+		return ret;
+	}
+
+	bool operator==(const flat_tree_iterator& other) const {
+		return _idx == other._idx;
+	}
+	bool operator!=(const flat_tree_iterator& other) const {
+		return !(*this == other);
+	}
+
+	// The node index in the tree.
+	uint32_t index() const {
+		return _idx;
+	}
+	tree_type* tree() const {
+		return _tree;
+	}
+
+private:
+	tree_type* _tree = nullptr;
+	uint32_t _idx = (std::numeric_limits<uint32_t>::max)();
+};
+
+// A tree stored in a single vector, nodes are linked with indices.
+// Nodes are addressed with stable uint32_t indices, until compact() is
+// called.
+// Inserting is O(1) amortized, erased slots are reused.
+// Erasing a node erases its sub-tree. Erased values are destroyed when their
+// slot is reused, or on compaction.
+// Call compact() periodically (for example when free_size() grows larger than
+// size()) to remove the holes and store nodes in depth-first order.
+template <class T>
+struct flat_tree {
+	using value_type = T;
+	using iterator = flat_tree_iterator<T, false>;
+	using const_iterator = flat_tree_iterator<T, true>;
+
+	static constexpr uint32_t npos = (std::numeric_limits<uint32_t>::max)();
+
+	flat_tree() = default;
+
+	// Iterator to the root, pass it to the apis.
+	iterator root() {
+		return { this, _root };
+	}
+	const_iterator root() const {
+		return { this, _root };
+	}
+
+	// Number of nodes.
+	size_t size() const {
+		return _nodes.size() - _free.size();
+	}
+	bool empty() const {
+		return _root == npos;
+	}
+	// Number of erased slots waiting for reuse.
+	size_t free_size() const {
+		return _free.size();
+	}
+
+	void reserve(size_t new_cap) {
+		_nodes.reserve(new_cap);
+	}
+
+	void clear() {
+		_nodes.clear();
+		_free.clear();
+		_root = npos;
+	}
+
+	T& operator[](uint32_t idx) {
+		return _nodes[idx].value;
+	}
+	const T& operator[](uint32_t idx) const {
+		return _nodes[idx].value;
+	}
+
+	uint32_t parent(uint32_t idx) const {
+		return _nodes[idx].parent;
+	}
+	uint32_t first_child(uint32_t idx) const {
+		return _nodes[idx].first_child;
+	}
+	uint32_t next_sibling(uint32_t idx) const {
+		return _nodes[idx].next_sibling;
+	}
+
+	// Creates the root. The tree must be empty.
+	uint32_t insert_root(T value) {
+		assert(empty());
+		_root = make_node(std::move(value), npos);
+		return _root;
+	}
+
+	// Inserts value as the last child of parent.
+	uint32_t insert(uint32_t parent, T value) {
+		uint32_t idx = make_node(std::move(value), parent);
+
+		node& p = _nodes[parent];
+		if (p.last_child == npos) {
+			p.first_child = idx;
+		} else {
+			_nodes[p.last_child].next_sibling = idx;
+			_nodes[idx].prev_sibling = p.last_child;
+		}
+		p.last_child = idx;
+		return idx;
+	}
+
+	// Erases the node and its sub-tree.
+	void erase(uint32_t idx) {
+		if (idx == _root) {
+			clear();
+			return;
+		}
+
+		// Unlink.
+		node& n = _nodes[idx];
+		node& p = _nodes[n.parent];
+		if (n.prev_sibling == npos) {
+			p.first_child = n.next_sibling;
+		} else {
+			_nodes[n.prev_sibling].next_sibling = n.next_sibling;
+		}
+		if (n.next_sibling == npos) {
+			p.last_child = n.prev_sibling;
+		} else {
+			_nodes[n.next_sibling].prev_sibling = n.prev_sibling;
+		}
+		n.next_sibling = npos;
+
+		// Free the sub-tree slots.
+		for_each_depthfirst_flat(iterator{ this, idx },
+				[this](iterator it) { _free.push_back(it.index()); });
+	}
+
+	// Removes erased slots and stores the nodes in depth-first order.
+	// Invalidates indices. Returns the new index of every old index, or npos
+	// for erased slots.
+	std::vector<uint32_t> compact() {
+		std::vector<uint32_t> new_idxes(_nodes.size(), npos);
+		if (empty()) {
+			clear();
+			return new_idxes;
+		}
+
+		std::vector<node> new_nodes;
+		new_nodes.reserve(size());
+		for_each_depthfirst_flat(root(), [&](iterator it) {
+			new_idxes[it.index()] = uint32_t(new_nodes.size());
+			new_nodes.push_back(std::move(_nodes[it.index()]));
+		});
+
+		for (node& n : new_nodes) {
+			n.parent = remap(new_idxes, n.parent);
+			n.first_child = remap(new_idxes, n.first_child);
+			n.last_child = remap(new_idxes, n.last_child);
+			n.next_sibling = remap(new_idxes, n.next_sibling);
+			n.prev_sibling = remap(new_idxes, n.prev_sibling);
+		}
+
+		_nodes = std::move(new_nodes);
+		_free.clear();
+		_root = 0;
+		return new_idxes;
+	}
+
+private:
+	struct node {
+		T value;
+		uint32_t parent = npos;
+		uint32_t first_child = npos;
+		uint32_t last_child = npos;
+		uint32_t next_sibling = npos;
+		uint32_t prev_sibling = npos;
+	};
+
+	static uint32_t remap(const std::vector<uint32_t>& new_idxes, uint32_t idx) {
+		return idx == npos ? npos : new_idxes[idx];
+	}
+
+	uint32_t make_node(T&& value, uint32_t parent) {
+		node n{ std::move(value), parent };
+
+		if (_free.empty()) {
+			_nodes.push_back(std::move(n));
+			return uint32_t(_nodes.size() - 1);
+		}
+
+		uint32_t idx = _free.back();
+		_free.pop_back();
+		_nodes[idx] = std::move(n);
+		return idx;
+	}
+
+	std::vector<node> _nodes;
+	std::vector<uint32_t> _free;
+	uint32_t _root = npos;
+};
+
+template <class T>
+constexpr uint32_t flat_tree<T>::npos;
+
+// Found through ADL.
+template <class T, bool IsConst, class StatePtr>
+inline std::pair<flat_tree_iterator<T, IsConst>, flat_tree_iterator<T, IsConst>>
+children_range(flat_tree_iterator<T, IsConst> parent, StatePtr*) {
+	return { { parent.tree(), parent.tree()->first_child(parent.index()) },
+		{ parent.tree(), flat_tree<T>::npos } };
+}
+
+// Found through ADL.
+template <class T, bool IsConst, class StatePtr>
+inline flat_tree_iterator<T, IsConst> parent_node(
+		flat_tree_iterator<T, IsConst> node, StatePtr*) {
+	return { node.tree(), node.tree()->parent(node.index()) };
+}
+} // namespace fea
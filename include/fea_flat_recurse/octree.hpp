@@ -0,0 +1,661 @@
+#pragma once
+/*
+BSD 3-Clause License
+
+Copyright (c) 2019, Philippe Groarke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "fea_flat_recurse.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace fea {
+/*
+ Morton Codes
+*/
+
+// Morton codes interleave 21 bits per axis, x in the lowest bit. Sorting
+// codes sorts points in z-order, every octree node is a contiguous range.
+constexpr uint32_t morton_max_level = 21;
+
+namespace detail {
+inline uint64_t morton_expand(uint32_t v) {
+	uint64_t ret = v & 0x1fffff;
+	ret = (ret | ret << 32) & 0x1f00000000ffff;
+	ret = (ret | ret << 16) & 0x1f0000ff0000ff;
+	ret = (ret | ret << 8) & 0x100f00f00f00f00f;
+	ret = (ret | ret << 4) & 0x10c30c30c30c30c3;
+	ret = (ret | ret << 2) & 0x1249249249249249;
+	return ret;
+}
+
+inline uint32_t morton_compact(uint64_t v) {
+	v &= 0x1249249249249249;
+	v = (v ^ (v >> 2)) & 0x10c30c30c30c30c3;
+	v = (v ^ (v >> 4)) & 0x100f00f00f00f00f;
+	v = (v ^ (v >> 8)) & 0x1f0000ff0000ff;
+	v = (v ^ (v >> 16)) & 0x1f00000000ffff;
+	v = (v ^ (v >> 32)) & 0x1fffff;
+	return uint32_t(v);
+}
+} // namespace detail
+
+// Coordinates must fit in 21 bits.
+inline uint64_t morton_encode(uint32_t x, uint32_t y, uint32_t z) {
+	return detail::morton_expand(x) | detail::morton_expand(y) << 1
+			| detail::morton_expand(z) << 2;
+}
+
+inline void morton_decode(
+		uint64_t code, uint32_t* x, uint32_t* y, uint32_t* z) {
+	*x = detail::morton_compact(code);
+	*y = detail::morton_compact(code >> 1);
+	*z = detail::morton_compact(code >> 2);
+}
+
+// The octant of code at level, in [1, morton_max_level]. Level 1 are the
+// root's children.
+inline uint32_t morton_octant(uint64_t code, uint32_t level) {
+	return uint32_t(code >> (3 * (morton_max_level - level))) & 7u;
+}
+
+namespace detail {
+// Runs func(chunk, begin, end) on up to num_chunks contiguous chunks of
+// [0, n).
+template <class Executor, class Func>
+inline void bulk_chunked(
+		Executor& executor, size_t n, size_t num_chunks, Func func) {
+	if (n == 0) {
+		return;
+	}
+
+	num_chunks = (std::min)(num_chunks, n);
+	size_t chunk_size = (n + num_chunks - 1) / num_chunks;
+	num_chunks = (n + chunk_size - 1) / chunk_size;
+	executor.bulk(num_chunks, [&](size_t chunk) {
+		size_t begin = chunk * chunk_size;
+		func(chunk, begin, (std::min)(begin + chunk_size, n));
+	});
+}
+
+// Stable least significant digit radix sort of keys, values follow their
+// key. Sorts the low num_bits of the keys, 8 bits per pass. Chunks count
+// their digits in parallel, then scatter to their own offsets.
+// Passes where every key shares the same digit are skipped.
+template <class Executor>
+inline void radix_sort_par(Executor& executor, size_t num_chunks,
+		uint32_t num_bits, std::vector<uint64_t>* keys,
+		std::vector<uint32_t>* values, std::vector<uint64_t>* scratch_keys,
+		std::vector<uint32_t>* scratch_values,
+		std::vector<uint32_t>* histograms) {
+	const size_t n = keys->size();
+	if (n <= 1) {
+		return;
+	}
+
+	constexpr size_t radix = 256;
+	num_chunks = (std::min)(num_chunks, n);
+	scratch_keys->resize(n);
+	scratch_values->resize(n);
+
+	for (uint32_t shift = 0; shift < num_bits; shift += 8) {
+		histograms->assign(num_chunks * radix, 0);
+		uint32_t* hist = histograms->data();
+
+		bulk_chunked(executor, n, num_chunks,
+				[&](size_t chunk, size_t begin, size_t end) {
+					const uint64_t* k = keys->data();
+					uint32_t* h = hist + chunk * radix;
+					for (size_t i = begin; i < end; ++i) {
+						++h[(k[i] >> shift) & 0xff];
+					}
+				});
+
+		// Offsets, digit major so the sort is stable.
+		bool trivial = false;
+		uint32_t offset = 0;
+		for (size_t d = 0; d < radix; ++d) {
+			uint32_t digit_count = 0;
+			for (size_t c = 0; c < num_chunks; ++c) {
+				uint32_t count = hist[c * radix + d];
+				hist[c * radix + d] = offset + digit_count;
+				digit_count += count;
+			}
+			trivial |= digit_count == n;
+			offset += digit_count;
+		}
+
+		if (trivial) {
+			continue;
+		}
+
+		bulk_chunked(executor, n, num_chunks,
+				[&](size_t chunk, size_t begin, size_t end) {
+					const uint64_t* k = keys->data();
+					const uint32_t* v = values->data();
+					uint64_t* out_k = scratch_keys->data();
+					uint32_t* out_v = scratch_values->data();
+					uint32_t* h = hist + chunk * radix;
+					for (size_t i = begin; i < end; ++i) {
+						uint32_t dst = h[(k[i] >> shift) & 0xff]++;
+						out_k[dst] = k[i];
+						out_v[dst] = v[i];
+					}
+				});
+
+		keys->swap(*scratch_keys);
+		values->swap(*scratch_values);
+	}
+}
+} // namespace detail
+
+
+/*
+ Octree
+*/
+
+struct octree;
+
+// A node covers the sorted points [first_point, last_point).
+// Children are stored contiguously, starting at first_child.
+struct octree_node {
+	uint32_t first_point = 0;
+	uint32_t last_point = 0;
+	uint32_t first_child = (std::numeric_limits<uint32_t>::max)();
+	uint8_t num_children = 0;
+	uint8_t level = 0;
+};
+
+// Iterates siblings. Returned by children_range, use the tree's root() to
+// start a traversal. No state pointer is required.
+struct octree_iterator {
+	using value_type = octree_node;
+	using pointer = const octree_node*;
+	using reference = const octree_node&;
+	using iterator_category = std::bidirectional_iterator_tag;
+	using difference_type = std::ptrdiff_t;
+
+	octree_iterator() = default;
+	octree_iterator(const octree* tree, uint32_t idx)
+			: _tree(tree)
+			, _idx(idx) {
+	}
+
+	reference operator*() const;
+	pointer operator->() const;
+
+	octree_iterator& operator++() {
+		++_idx;
+		return *this;
+	}
+	octree_iterator operator++(int) {
+		octree_iterator ret = *this;
+		++*this;
+		return ret;
+	}
+	octree_iterator& operator--() {
+		--_idx;
+		return *this;
+	}
+	octree_iterator operator--(int) {
+		octree_iterator ret = *this;
+		--*this;
+		return ret;
+	}
+
+	bool operator==(const octree_iterator& other) const {
+		return _idx == other._idx;
+	}
+	bool operator!=(const octree_iterator& other) const {
+		return !(*this == other);
+	}
+
+	// The node index in the tree.
+	uint32_t index() const {
+		return _idx;
+	}
+	const octree* tree() const {
+		return _tree;
+	}
+
+private:
+	const octree* _tree = nullptr;
+	uint32_t _idx = (std::numeric_limits<uint32_t>::max)();
+};
+
+// A compact octree of points, built in parallel with build_octree.
+// Points are sorted by morton code, nodes are ranges of sorted points.
+// Nodes are stored breadth-first, siblings are contiguous.
+// Rebuilding reuses the tree's memory, keep it around.
+struct octree {
+	using const_iterator = octree_iterator;
+
+	static constexpr uint32_t npos = (std::numeric_limits<uint32_t>::max)();
+
+	octree() = default;
+
+	// Iterator to the root, pass it to the apis. The tree must not be empty.
+	const_iterator root() const {
+		assert(!empty());
+		return { this, 0 };
+	}
+
+	// Number of nodes.
+	size_t size() const {
+		return _nodes.size();
+	}
+	bool empty() const {
+		return _nodes.empty();
+	}
+
+	const octree_node& operator[](uint32_t idx) const {
+		return _nodes[idx];
+	}
+
+	// The sorted morton codes of the points.
+	const std::vector<uint64_t>& codes() const {
+		return _codes;
+	}
+
+	// The input index of every sorted point.
+	const std::vector<uint32_t>& point_indices() const {
+		return _point_indices;
+	}
+
+	// The node's bounding cube.
+	void bounds(uint32_t idx, std::array<float, 3>* min, float* size) const {
+		const octree_node& n = _nodes[idx];
+		*size = _size / float(1u << n.level);
+
+		uint32_t shift = 3 * (morton_max_level - n.level);
+		uint64_t prefix = (_codes[n.first_point] >> shift) << shift;
+		std::array<uint32_t, 3> cell;
+		morton_decode(prefix, &cell[0], &cell[1], &cell[2]);
+
+		float cell_size = _size / float(1u << morton_max_level);
+		for (size_t i = 0; i < 3; ++i) {
+			(*min)[i] = _min[i] + float(cell[i]) * cell_size;
+		}
+	}
+
+	void clear() {
+		_nodes.clear();
+		_codes.clear();
+		_point_indices.clear();
+	}
+
+	// Use build_octree.
+	// RandomIt dereferences to points, which provide p[0], p[1] and p[2].
+	// Nodes with max_leaf_size points or less are leaves.
+	template <class Executor, class RandomIt>
+	void build(Executor& executor, RandomIt first, RandomIt last,
+			uint32_t max_leaf_size);
+
+private:
+	std::vector<octree_node> _nodes;
+	std::vector<uint64_t> _codes;
+	std::vector<uint32_t> _point_indices;
+	std::array<float, 3> _min{};
+	float _size = 1.f;
+
+	// Build scratch, kept to reuse memory.
+	std::vector<uint64_t> _scratch_codes;
+	std::vector<uint32_t> _scratch_indices;
+	std::vector<uint32_t> _histograms;
+	std::vector<std::array<uint32_t, 9>> _splits;
+	std::vector<uint32_t> _child_offsets;
+	std::vector<std::array<float, 6>> _chunk_bounds;
+};
+
+inline const octree_node& octree_iterator::operator*() const {
+	return (*_tree)[_idx];
+}
+inline const octree_node* octree_iterator::operator->() const {
+	return &(*_tree)[_idx];
+}
+
+template <class Executor, class RandomIt>
+void octree::build(Executor& executor, RandomIt first, RandomIt last,
+		uint32_t max_leaf_size) {
+	clear();
+	const size_t n = size_t(std::distance(first, last));
+	assert(n < npos);
+	if (n == 0) {
+		return;
+	}
+
+	const size_t num_chunks = executor.concurrency() * 4;
+	max_leaf_size = (std::max)(max_leaf_size, 1u);
+
+	// Bounds.
+	constexpr float flt_max = (std::numeric_limits<float>::max)();
+	_chunk_bounds.assign(num_chunks,
+			{ flt_max, flt_max, flt_max, -flt_max, -flt_max, -flt_max });
+	detail::bulk_chunked(executor, n, num_chunks,
+			[&](size_t chunk, size_t begin, size_t end) {
+				std::array<float, 6>& b = _chunk_bounds[chunk];
+				for (size_t i = begin; i < end; ++i) {
+					const auto& p = first[i];
+					for (size_t a = 0; a < 3; ++a) {
+						b[a] = (std::min)(b[a], float(p[a]));
+						b[a + 3] = (std::max)(b[a + 3], float(p[a]));
+					}
+				}
+			});
+
+	std::array<float, 6> bounds = _chunk_bounds.front();
+	for (const std::array<float, 6>& b : _chunk_bounds) {
+		for (size_t a = 0; a < 3; ++a) {
+			bounds[a] = (std::min)(bounds[a], b[a]);
+			bounds[a + 3] = (std::max)(bounds[a + 3], b[a + 3]);
+		}
+	}
+
+	_size = 0.f;
+	for (size_t a = 0; a < 3; ++a) {
+		_min[a] = bounds[a];
+		_size = (std::max)(_size, bounds[a + 3] - bounds[a]);
+	}
+	if (_size <= 0.f) {
+		_size = 1.f;
+	}
+
+	// Morton codes.
+	constexpr uint32_t max_cell = (1u << morton_max_level) - 1;
+	const float scale = float(1u << morton_max_level) / _size;
+	_codes.resize(n);
+	_point_indices.resize(n);
+	detail::bulk_chunked(executor, n, num_chunks,
+			[&](size_t, size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					const auto& p = first[i];
+					std::array<uint32_t, 3> cell;
+					for (size_t a = 0; a < 3; ++a) {
+						float c = (float(p[a]) - _min[a]) * scale;
+						cell[a] = (std::min)(uint32_t(c), max_cell);
+					}
+					_codes[i] = morton_encode(cell[0], cell[1], cell[2]);
+					_point_indices[i] = uint32_t(i);
+				}
+			});
+
+	detail::radix_sort_par(executor, num_chunks, 3 * morton_max_level,
+			&_codes, &_point_indices, &_scratch_codes, &_scratch_indices,
+			&_histograms);
+
+	// Nodes, one level at a time. A node's points share their first level
+	// octants, its children split where the next octant changes.
+	_nodes.push_back({ 0, uint32_t(n), npos, 0, 0 });
+	size_t level_begin = 0;
+	size_t level_end = 1;
+	while (level_begin != level_end) {
+		const size_t level_size = level_end - level_begin;
+		_splits.resize(level_size);
+		_child_offsets.resize(level_size + 1);
+
+		detail::bulk_chunked(executor, level_size, num_chunks,
+				[&](size_t, size_t begin, size_t end) {
+					for (size_t i = begin; i < end; ++i) {
+						const octree_node& node = _nodes[level_begin + i];
+						std::array<uint32_t, 9>& splits = _splits[i];
+						uint32_t num_children = 0;
+
+						if (node.last_point - node.first_point > max_leaf_size
+								&& node.level < morton_max_level) {
+							const uint64_t* codes = _codes.data();
+							uint32_t level = node.level + 1u;
+							splits[0] = node.first_point;
+							splits[8] = node.last_point;
+							for (uint32_t o = 1; o < 8; ++o) {
+								splits[o] = uint32_t(
+										std::partition_point(
+												codes + splits[o - 1],
+												codes + node.last_point,
+												[&](uint64_t code) {
+													return morton_octant(
+																   code, level)
+															< o;
+												})
+										- codes);
+							}
+
+							for (uint32_t o = 0; o < 8; ++o) {
+								num_children += splits[o] != splits[o + 1];
+							}
+						}
+						_child_offsets[i] = num_children;
+					}
+				});
+
+		// Exclusive scan, children are appended after this level.
+		uint32_t offset = uint32_t(level_end);
+		for (size_t i = 0; i < level_size; ++i) {
+			uint32_t count = _child_offsets[i];
+			_child_offsets[i] = offset;
+			offset += count;
+		}
+		_child_offsets[level_size] = offset;
+
+		_nodes.resize(offset);
+		detail::bulk_chunked(executor, level_size, num_chunks,
+				[&](size_t, size_t begin, size_t end) {
+					for (size_t i = begin; i < end; ++i) {
+						octree_node& node = _nodes[level_begin + i];
+						uint32_t child_idx = _child_offsets[i];
+						uint32_t num_children
+								= _child_offsets[i + 1] - child_idx;
+						if (num_children == 0) {
+							continue;
+						}
+
+						node.first_child = child_idx;
+						node.num_children = uint8_t(num_children);
+
+						const std::array<uint32_t, 9>& splits = _splits[i];
+						for (uint32_t o = 0; o < 8; ++o) {
+							if (splits[o] == splits[o + 1]) {
+								continue;
+							}
+							_nodes[child_idx++] = { splits[o], splits[o + 1],
+								npos, 0, uint8_t(node.level + 1) };
+						}
+					}
+				});
+
+		level_begin = level_end;
+		level_end = _nodes.size();
+	}
+}
+
+// Builds an octree of the points [first, last), on executor.
+// RandomIt dereferences to points, which provide p[0], p[1] and p[2].
+// Nodes with max_leaf_size points or less are leaves.
+// Rebuilding an existing tree reuses its memory.
+template <class Executor, class RandomIt,
+		std::enable_if_t<detail::is_executor<Executor>::value, int> = 0>
+inline void build_octree(Executor& executor, RandomIt first, RandomIt last,
+		octree* out, uint32_t max_leaf_size = 1) {
+	out->build(executor, first, last, max_leaf_size);
+}
+
+// Builds an octree of the points [first, last), on default_executor().
+// RandomIt dereferences to points, which provide p[0], p[1] and p[2].
+// Nodes with max_leaf_size points or less are leaves.
+template <class RandomIt,
+		std::enable_if_t<!detail::is_executor<RandomIt>::value, int> = 0>
+inline void build_octree(RandomIt first, RandomIt last, octree* out,
+		uint32_t max_leaf_size = 1) {
+	return build_octree(default_executor(), first, last, out, max_leaf_size);
+}
+
+// Found through ADL.
+template <class StatePtr>
+inline std::pair<octree_iterator, octree_iterator> children_range(
+		octree_iterator parent, StatePtr*) {
+	const octree_node& n = *parent;
+	return { { parent.tree(), n.first_child },
+		{ parent.tree(), n.first_child + n.num_children } };
+}
+
+
+/*
+ Morton Octree
+*/
+
+namespace detail {
+// The end of the run of keys which share their first level octants with
+// *first. Gallops from first, runs are short near the leaves.
+inline const uint64_t* morton_run_end(
+		const uint64_t* first, const uint64_t* last, uint32_t level) {
+	uint32_t shift = 3 * (morton_max_level - level);
+	uint64_t limit = ((*first >> shift) + 1) << shift;
+
+	const uint64_t* lo = first;
+	size_t step = 1;
+	while (size_t(last - lo) > step && lo[step] < limit) {
+		lo += step;
+		step *= 2;
+	}
+
+	const uint64_t* hi = size_t(last - lo) > step ? lo + step : last;
+	return std::lower_bound(lo, hi, limit);
+}
+} // namespace detail
+
+// Treats a sorted array of morton codes as a sparse octree, without storing
+// nodes. A node is the run of keys sharing its first level octants, children
+// are found by galloping over the parent's keys.
+// Nodes with a single key, or at morton_max_level, are leaves. Duplicate keys
+// share a leaf.
+// Dereferences to the node's first key. Use make_morton_octree_root to start
+// a traversal. No state pointer is required.
+struct morton_octree_iterator {
+	using value_type = uint64_t;
+	using pointer = const uint64_t*;
+	using reference = const uint64_t&;
+	using iterator_category = std::forward_iterator_tag;
+	using difference_type = std::ptrdiff_t;
+
+	morton_octree_iterator() = default;
+	morton_octree_iterator(
+			const uint64_t* first, const uint64_t* parent_last, uint32_t level)
+			: _first(first)
+			, _last(first)
+			, _parent_last(parent_last)
+			, _level(level) {
+		if (_first != _parent_last) {
+			_last = detail::morton_run_end(_first, _parent_last, _level);
+		}
+	}
+
+	reference operator*() const {
+		return *_first;
+	}
+	pointer operator->() const {
+		return _first;
+	}
+
+	morton_octree_iterator& operator++() {
+		_first = _last;
+		if (_first != _parent_last) {
+			_last = detail::morton_run_end(_first, _parent_last, _level);
+		}
+		return *this;
+	}
+	morton_octree_iterator operator++(int) {
+		morton_octree_iterator ret = *this;
+		++*this;
+		return ret;
+	}
+
+	bool operator==(const morton_octree_iterator& other) const {
+		return _first == other._first;
+	}
+	bool operator!=(const morton_octree_iterator& other) const {
+		return !(*this == other);
+	}
+
+	// The node's keys.
+	const uint64_t* key_begin() const {
+		return _first;
+	}
+	const uint64_t* key_end() const {
+		return _last;
+	}
+
+	// The node's depth, the root is level 0.
+	uint32_t level() const {
+		return _level;
+	}
+
+	// The key of the node's minimum corner.
+	uint64_t prefix() const {
+		uint32_t shift = 3 * (morton_max_level - _level);
+		return (*_first >> shift) << shift;
+	}
+
+	bool is_leaf() const {
+		return _last - _first == 1 || _level == morton_max_level;
+	}
+
+private:
+	const uint64_t* _first = nullptr;
+	const uint64_t* _last = nullptr;
+	const uint64_t* _parent_last = nullptr;
+	uint32_t _level = 0;
+};
+
+// Returns the root of the sorted morton codes [first, last), which must not
+// be empty.
+inline morton_octree_iterator make_morton_octree_root(
+		const uint64_t* first, const uint64_t* last) {
+	assert(first != last);
+	return { first, last, 0 };
+}
+
+// Found through ADL.
+template <class StatePtr>
+inline std::pair<morton_octree_iterator, morton_octree_iterator>
+children_range(morton_octree_iterator parent, StatePtr*) {
+	morton_octree_iterator end{ parent.key_end(), parent.key_end(),
+		parent.level() + 1 };
+	if (parent.is_leaf()) {
+		return { end, end };
+	}
+	return { { parent.key_begin(), parent.key_end(), parent.level() + 1 },
+		end };
+}
+} // namespace fea
@@ -0,0 +1,225 @@
+#pragma once
+/*
+BSD 3-Clause License
+
+Copyright (c) 2019, Philippe Groarke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "fea_flat_recurse.hpp"
+
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+namespace fea {
+/*
+ Relayout
+*/
+
+// Node orders supported by relayout.
+// depthfirst : pre-order, a sub-tree is contiguous.
+// breadthfirst : siblings are contiguous.
+// van_emde_boas : cache-oblivious, recursively splits the tree in half
+// heights. Good locality for root to leaf paths at every cache size.
+enum class layout_order {
+	depthfirst,
+	breadthfirst,
+	van_emde_boas,
+};
+
+// A tree stored in a contiguous arena, created by relayout.
+// Nodes are stored in the chosen order, the root is at index 0.
+// Iterators are pointers to child indices, use the tree as the state
+// pointer. They work with all the apis.
+template <class T>
+struct relayout_tree {
+	using iter = const uint32_t*;
+
+	// Iterator to the root, pass it to the apis.
+	// Doesn't point into the tree, it stays valid when the tree is moved.
+	iter root() const {
+		static const uint32_t root_idx = 0;
+		return &root_idx;
+	}
+
+	typename std::vector<T>::reference operator[](iter it) {
+		return nodes[*it];
+	}
+	typename std::vector<T>::const_reference operator[](iter it) const {
+		return nodes[*it];
+	}
+
+	size_t size() const {
+		return nodes.size();
+	}
+
+	// Node payloads.
+	std::vector<T> nodes;
+
+	// Children of node i are children[child_offsets[i], child_offsets[i+1]).
+	std::vector<uint32_t> children;
+	std::vector<uint32_t> child_offsets;
+};
+
+// Found through ADL.
+template <class T>
+inline std::pair<const uint32_t*, const uint32_t*> children_range(
+		const uint32_t* parent, const relayout_tree<T>* tree) {
+	const uint32_t* beg = tree->children.data();
+	return { beg + tree->child_offsets[*parent],
+		beg + tree->child_offsets[*parent + 1] };
+}
+template <class T>
+inline std::pair<const uint32_t*, const uint32_t*> children_range(
+		const uint32_t* parent, relayout_tree<T>* tree) {
+	const relayout_tree<T>* ctree = tree;
+	return children_range(parent, ctree);
+}
+
+namespace detail {
+// Appends the van Emde Boas order of the sub-tree starting at root, cut at
+// height. Children of bfs index i are [first_child[i], first_child[i + 1]).
+inline void van_emde_boas_order(uint32_t root, size_t height,
+		const std::vector<uint32_t>& first_child, std::vector<uint32_t>* out) {
+	if (height == 1) {
+		out->push_back(root);
+		return;
+	}
+
+	// Top tree first, then bottom trees left to right.
+	size_t top_height = height / 2;
+	van_emde_boas_order(root, top_height, first_child, out);
+
+	std::vector<uint32_t> bottom_roots{ root };
+	std::vector<uint32_t> next;
+	for (size_t i = 0; i < top_height; ++i) {
+		next.clear();
+		for (uint32_t idx : bottom_roots) {
+			for (uint32_t c = first_child[idx]; c < first_child[idx + 1];
+					++c) {
+				next.push_back(c);
+			}
+		}
+		bottom_roots.swap(next);
+	}
+
+	for (uint32_t idx : bottom_roots) {
+		van_emde_boas_order(idx, height - top_height, first_child, out);
+	}
+}
+} // namespace detail
+
+// Copies the tree starting at root in a contiguous arena, in the provided
+// order. Child links are rewritten as indices.
+// NodeFunc accepts an iterator and returns the node payload to store.
+// Don't copy your children containers, only the data you need.
+template <class InputIt, class NodeFunc, class StatePtr = const void>
+inline auto relayout(InputIt root, layout_order order, NodeFunc node_func,
+		StatePtr* state_ptr = nullptr) {
+	using value_type = std::decay_t<decltype(node_func(root))>;
+
+	// Gather breadth-first, children of a node are contiguous.
+	// Store the children offsets to navigate the tree by indices.
+	std::vector<InputIt> bfs_its;
+	gather_breadthfirst(root, &bfs_its, state_ptr);
+
+	std::vector<uint32_t> first_child;
+	first_child.reserve(bfs_its.size() + 1);
+	std::vector<uint32_t> depths(bfs_its.size(), 0);
+	uint32_t next_child = 1;
+	for (size_t i = 0; i < bfs_its.size(); ++i) {
+		first_child.push_back(next_child);
+
+		using fea::children_range;
+		std::pair<InputIt, InputIt> range
+				= children_range(bfs_its[i], state_ptr);
+		uint32_t num_children
+				= uint32_t(std::distance(range.first, range.second));
+
+		for (uint32_t c = next_child; c < next_child + num_children; ++c) {
+			depths[c] = depths[i] + 1;
+		}
+		next_child += num_children;
+	}
+	first_child.push_back(next_child);
+
+	// Last breadth-first node is the deepest.
+	size_t height = size_t(depths.back()) + 1;
+
+	// Compute the new order, as bfs indices.
+	std::vector<uint32_t> order_idxes;
+	order_idxes.reserve(bfs_its.size());
+	switch (order) {
+	case layout_order::breadthfirst: {
+		for (uint32_t i = 0; i < uint32_t(bfs_its.size()); ++i) {
+			order_idxes.push_back(i);
+		}
+	} break;
+	case layout_order::depthfirst: {
+		std::vector<uint32_t> stack{ 0 };
+		while (!stack.empty()) {
+			uint32_t idx = stack.back();
+			stack.pop_back();
+			order_idxes.push_back(idx);
+
+			for (uint32_t c = first_child[idx + 1]; c > first_child[idx];) {
+				stack.push_back(--c);
+			}
+		}
+	} break;
+	case layout_order::van_emde_boas: {
+		detail::van_emde_boas_order(0, height, first_child, &order_idxes);
+	} break;
+	}
+
+	// Inverse mapping, bfs index to new index.
+	std::vector<uint32_t> new_idxes(bfs_its.size());
+	for (uint32_t i = 0; i < uint32_t(order_idxes.size()); ++i) {
+		new_idxes[order_idxes[i]] = i;
+	}
+
+	relayout_tree<value_type> ret;
+	ret.nodes.reserve(bfs_its.size());
+	ret.children.reserve(bfs_its.size() == 0 ? 0 : bfs_its.size() - 1);
+	ret.child_offsets.reserve(bfs_its.size() + 1);
+
+	for (uint32_t bfs_idx : order_idxes) {
+		ret.nodes.push_back(node_func(bfs_its[bfs_idx]));
+		ret.child_offsets.push_back(uint32_t(ret.children.size()));
+
+		for (uint32_t c = first_child[bfs_idx]; c < first_child[bfs_idx + 1];
+				++c) {
+			ret.children.push_back(new_idxes[c]);
+		}
+	}
+	ret.child_offsets.push_back(uint32_t(ret.children.size()));
+
+	return ret;
+}
+} // namespace fea
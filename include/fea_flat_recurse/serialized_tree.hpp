@@ -0,0 +1,416 @@
+#pragma once
+/*
+BSD 3-Clause License
+
+Copyright (c) 2019, Philippe Groarke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "fea_flat_recurse.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+// Full windows.h, its include guard would strip a lean build from includers.
+// NOMINMAX only for this include, undefined after so includers are
+// unaffected.
+#if !defined(NOMINMAX)
+#define NOMINMAX
+#define FEA_FLAT_RECURSE_UNDEF_NOMINMAX
+#endif
+#include <windows.h>
+#if defined(FEA_FLAT_RECURSE_UNDEF_NOMINMAX)
+#undef NOMINMAX
+#undef FEA_FLAT_RECURSE_UNDEF_NOMINMAX
+#endif
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fea {
+/*
+ Serialized Tree
+*/
+
+// A tree serialized as depth-first (pre-order) records, traversable directly
+// from memory (or a memory mapped file) without deserialization.
+//
+// Layout, in native endianness :
+// - serialized_tree_header, padded to serialized_tree_records_offset bytes.
+// - One serialized_record<T> per node, in pre-order.
+//
+// A node's first child is the next record. Its next sibling is
+// subtree_size records further. Its children end at the end of its sub-tree.
+
+constexpr uint32_t serialized_tree_version = 1;
+constexpr size_t serialized_tree_records_offset = 64;
+
+struct serialized_tree_header {
+	char magic[4] = { 'F', 'F', 'R', 'T' };
+	uint32_t version = serialized_tree_version;
+	uint64_t num_nodes = 0;
+	uint32_t record_size = 0;
+	uint32_t record_align = 0;
+};
+
+template <class T>
+struct serialized_record {
+	// Number of records in this sub-tree, including this one.
+	uint32_t subtree_size;
+	uint32_t num_children;
+	T value;
+};
+
+// Iterates siblings. Returned by children_range, use the view's root() to
+// start a traversal. No state pointer is required.
+template <class T>
+struct serialized_tree_iterator {
+	using value_type = T;
+	using pointer = const T*;
+	using reference = const T&;
+	using iterator_category = std::forward_iterator_tag;
+	using difference_type = std::ptrdiff_t;
+
+	serialized_tree_iterator() = default;
+	explicit serialized_tree_iterator(const serialized_record<T>* record)
+			: _record(record) {
+	}
+
+	reference operator*() const {
+		return _record->value;
+	}
+	pointer operator->() const {
+		return &_record->value;
+	}
+
+	serialized_tree_iterator& operator++() {
+		_record += _record->subtree_size;
+		return *this;
+	}
+	serialized_tree_iterator operator++(int) {
+		serialized_tree_iterator ret = *this;
+		++*this;
+		return ret;
+	}
+
+	bool operator==(const serialized_tree_iterator& other) const {
+		return _record == other._record;
+	}
+	bool operator!=(const serialized_tree_iterator& other) const {
+		return !(*this == other);
+	}
+
+	const serialized_record<T>* record() const {
+		return _record;
+	}
+
+private:
+	const serialized_record<T>* _record = nullptr;
+};
+
+// Found through ADL.
+template <class T, class StatePtr>
+inline std::pair<serialized_tree_iterator<T>, serialized_tree_iterator<T>>
+children_range(serialized_tree_iterator<T> parent, StatePtr*) {
+	const serialized_record<T>* rec = parent.record();
+	return { serialized_tree_iterator<T>{ rec + 1 },
+		serialized_tree_iterator<T>{ rec + rec->subtree_size } };
+}
+
+// Serializes the tree starting at root, in the format described above.
+// NodeFunc accepts an iterator and returns the value to store. It must be
+// trivially copyable.
+// Records store sizes as uint32_t. Trees with more nodes fail, os's failbit
+// is set and nothing is written.
+template <class InputIt, class NodeFunc, class StatePtr = const void>
+inline void serialize_tree(InputIt root, NodeFunc node_func, std::ostream& os,
+		StatePtr* state_ptr = nullptr) {
+	using value_type = std::decay_t<decltype(node_func(root))>;
+	using record_type = serialized_record<value_type>;
+	static_assert(std::is_trivially_copyable<value_type>::value,
+			"serialize_tree : values must be trivially copyable");
+	static_assert(alignof(record_type) <= serialized_tree_records_offset,
+			"serialize_tree : values alignment is too large");
+
+	std::vector<InputIt> nodes;
+	gather_depthfirst_flat(root, &nodes, state_ptr);
+
+	// Bounds sub-tree sizes and children counts too.
+	if (nodes.size() > (std::numeric_limits<uint32_t>::max)()) {
+		os.setstate(std::ios::failbit);
+		return;
+	}
+
+	std::vector<record_type> records(nodes.size());
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		using fea::children_range;
+		std::pair<InputIt, InputIt> range
+				= children_range(nodes[i], state_ptr);
+
+		records[i].num_children
+				= uint32_t(std::distance(range.first, range.second));
+		records[i].value = node_func(nodes[i]);
+	}
+
+	// Children sub-trees follow their parent, compute sizes back to front.
+	for (size_t i = records.size(); i-- > 0;) {
+		uint32_t subtree_size = 1;
+		for (uint32_t c = 0; c < records[i].num_children; ++c) {
+			subtree_size += records[i + subtree_size].subtree_size;
+		}
+		records[i].subtree_size = subtree_size;
+	}
+
+	serialized_tree_header header;
+	header.num_nodes = records.size();
+	header.record_size = uint32_t(sizeof(record_type));
+	header.record_align = uint32_t(alignof(record_type));
+
+	char padded_header[serialized_tree_records_offset] = {};
+	std::memcpy(padded_header, &header, sizeof(header));
+	os.write(padded_header, sizeof(padded_header));
+	os.write(reinterpret_cast<const char*>(records.data()),
+			std::streamsize(records.size() * sizeof(record_type)));
+}
+
+// Read-only view of a serialized tree. Doesn't own the memory.
+// The data must be aligned to at least alignof(serialized_record<T>), which
+// memory maps and allocations are.
+// Construction only checks the header and the data size, records are read
+// lazily by traversals. Call verify() once on untrusted files, traversals of a
+// verified view stay within the data.
+template <class T>
+struct serialized_tree_view {
+	using iterator = serialized_tree_iterator<T>;
+	using record_type = serialized_record<T>;
+
+	serialized_tree_view() = default;
+	serialized_tree_view(const void* data, size_t byte_size) {
+		if (byte_size < serialized_tree_records_offset) {
+			return;
+		}
+
+		serialized_tree_header header;
+		std::memcpy(&header, data, sizeof(header));
+
+		serialized_tree_header expected;
+		if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0
+				|| header.version != serialized_tree_version
+				|| header.record_size != sizeof(record_type)
+				|| header.record_align != alignof(record_type)) {
+			return;
+		}
+
+		if (header.num_nodes == 0
+				|| (byte_size - serialized_tree_records_offset)
+								/ sizeof(record_type)
+						< header.num_nodes) {
+			return;
+		}
+
+		_records = reinterpret_cast<const record_type*>(
+				static_cast<const char*>(data)
+				+ serialized_tree_records_offset);
+		_size = size_t(header.num_nodes);
+	}
+
+	// False if the data isn't a serialized tree of T.
+	bool valid() const {
+		return _records != nullptr;
+	}
+
+	// Checks sub-trees nest and children fill their parent exactly, so
+	// traversals never loop or leave the records. Returns false if the view
+	// is invalid or corrupt.
+	// Reads every record, in a single pre-order pass.
+	bool verify() const {
+		if (!valid()) {
+			return false;
+		}
+
+		// Open sub-trees, their end and their number of children left.
+		std::vector<std::pair<size_t, uint32_t>> stack;
+
+		for (size_t i = 0; i < _size; ++i) {
+			size_t subtree_size = _records[i].subtree_size;
+			if (subtree_size == 0 || subtree_size > _size - i) {
+				return false;
+			}
+
+			while (!stack.empty() && stack.back().first == i) {
+				if (stack.back().second != 0) {
+					return false;
+				}
+				stack.pop_back();
+			}
+
+			if (stack.empty()) {
+				// Only the root has no parent, it spans every record.
+				if (i != 0) {
+					return false;
+				}
+			} else {
+				std::pair<size_t, uint32_t>& parent = stack.back();
+				if (i + subtree_size > parent.first || parent.second == 0) {
+					return false;
+				}
+				--parent.second;
+			}
+
+			stack.push_back({ i + subtree_size, _records[i].num_children });
+		}
+
+		for (const std::pair<size_t, uint32_t>& open : stack) {
+			if (open.second != 0) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Iterator to the root, pass it to the apis.
+	iterator root() const {
+		return iterator{ _records };
+	}
+
+	size_t size() const {
+		return _size;
+	}
+
+	// Records in pre-order.
+	const record_type* records() const {
+		return _records;
+	}
+
+private:
+	const record_type* _records = nullptr;
+	size_t _size = 0;
+};
+
+// Read-only memory mapped file.
+struct mapped_file {
+	mapped_file() = default;
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	~mapped_file() {
+		close();
+	}
+
+	// Returns false on failure.
+	bool open(const char* path) {
+		close();
+
+#if defined(_WIN32)
+		HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr,
+				OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+			CloseHandle(file);
+			return false;
+		}
+
+		HANDLE mapping = CreateFileMappingA(
+				file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(file);
+		if (mapping == nullptr) {
+			return false;
+		}
+
+		void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+		if (data == nullptr) {
+			return false;
+		}
+
+		_data = data;
+		_size = size_t(file_size.QuadPart);
+#else
+		int fd = ::open(path, O_RDONLY);
+		if (fd == -1) {
+			return false;
+		}
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0) {
+			::close(fd);
+			return false;
+		}
+
+		void* data = mmap(
+				nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (data == MAP_FAILED) {
+			return false;
+		}
+
+		_data = data;
+		_size = size_t(st.st_size);
+#endif
+		return true;
+	}
+
+	void close() {
+		if (_data == nullptr) {
+			return;
+		}
+
+#if defined(_WIN32)
+		UnmapViewOfFile(_data);
+#else
+		munmap(_data, _size);
+#endif
+		_data = nullptr;
+		_size = 0;
+	}
+
+	const void* data() const {
+		return _data;
+	}
+	size_t size() const {
+		return _size;
+	}
+
+private:
+	void* _data = nullptr;
+	size_t _size = 0;
+};
+} // namespace fea
@@ -0,0 +1,551 @@
+#pragma once
+/*
+BSD 3-Clause License
+
+Copyright (c) 2019, Philippe Groarke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "fea_flat_recurse.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace fea {
+/*
+ Versioned Tree
+*/
+
+namespace detail {
+constexpr uint32_t vtree_npos = (std::numeric_limits<uint32_t>::max)();
+constexpr uint32_t vtree_chunk_shift = 8;
+constexpr uint32_t vtree_chunk_size = 1u << vtree_chunk_shift;
+constexpr uint32_t vtree_chunk_mask = vtree_chunk_size - 1;
+
+template <class T>
+struct vtree_node {
+	T value;
+	uint32_t parent = vtree_npos;
+	uint32_t first_child = vtree_npos;
+	uint32_t last_child = vtree_npos;
+	uint32_t next_sibling = vtree_npos;
+	uint32_t prev_sibling = vtree_npos;
+};
+
+// Nodes are copied on write, a chunk at a time.
+template <class T>
+struct vtree_chunk {
+	std::vector<vtree_node<T>> nodes;
+};
+
+// A published version. Immutable, shares unmodified chunks with the other
+// versions.
+template <class T>
+struct vtree_version {
+	const vtree_node<T>& node(uint32_t idx) const {
+		return chunks[idx >> vtree_chunk_shift]->nodes[idx & vtree_chunk_mask];
+	}
+
+	std::vector<const vtree_chunk<T>*> chunks;
+	uint32_t root = vtree_npos;
+	size_t size = 0;
+};
+} // namespace detail
+
+// Iterates the siblings of a snapshot. Returned by children_range, use the
+// snapshot's root() to start a traversal. No state pointer is required.
+template <class T>
+struct versioned_tree_iterator {
+	using value_type = T;
+	using pointer = const T*;
+	using reference = const T&;
+	using iterator_category = std::forward_iterator_tag;
+	using difference_type = std::ptrdiff_t;
+
+	versioned_tree_iterator() = default;
+	versioned_tree_iterator(
+			const detail::vtree_version<T>* version, uint32_t idx)
+			: _version(version)
+			, _idx(idx) {
+	}
+
+	reference operator*() const {
+		return _version->node(_idx).value;
+	}
+	pointer operator->() const {
+		return &_version->node(_idx).value;
+	}
+
+	versioned_tree_iterator& operator++() {
+		_idx = _version->node(_idx).next_sibling;
+		return *this;
+	}
+	versioned_tree_iterator operator++(int) {
+		versioned_tree_iterator ret = *this;
+		++*this;
+		return ret;
+	}
+
+	bool operator==(const versioned_tree_iterator& other) const {
+		return _idx == other._idx;
+	}
+	bool operator!=(const versioned_tree_iterator& other) const {
+		return !(*this == other);
+	}
+
+	// The node index in the tree.
+	uint32_t index() const {
+		return _idx;
+	}
+	const detail::vtree_version<T>* version() const {
+		return _version;
+	}
+
+private:
+	const detail::vtree_version<T>* _version = nullptr;
+	uint32_t _idx = detail::vtree_npos;
+};
+
+// A tree which readers traverse while a writer modifies it.
+// The writer edits a working copy, then publishes it. Readers traverse a
+// consistent snapshot of the last published version, without locks. Nodes
+// are stored in chunks, which are copied on their first write after a
+// publish. Unmodified chunks are shared between versions.
+// Old versions are reclaimed once no reader can see them. Readers announce
+// the epoch they started reading in, the writer frees versions retired
+// before the oldest announced epoch.
+//
+// All writer functions must be called from a single thread at a time.
+// Every reader thread uses its own reader, from make_reader(). A reader
+// holds one snapshot at a time. The tree must outlive its readers.
+template <class T>
+struct versioned_tree {
+	using value_type = T;
+	using const_iterator = versioned_tree_iterator<T>;
+
+	static constexpr uint32_t npos = detail::vtree_npos;
+
+private:
+	using node = detail::vtree_node<T>;
+	using chunk = detail::vtree_chunk<T>;
+	using version = detail::vtree_version<T>;
+
+	static constexpr uint64_t idle_epoch
+			= (std::numeric_limits<uint64_t>::max)();
+
+	struct reader_slot {
+		std::atomic<uint64_t> epoch{ idle_epoch };
+		bool in_use = false;
+	};
+
+public:
+	// A consistent, read-only view of a published version. Releases it on
+	// destruction.
+	struct snapshot {
+		snapshot() = default;
+		snapshot(reader_slot* slot, const version* v)
+				: _slot(slot)
+				, _version(v) {
+		}
+		snapshot(snapshot&& other) noexcept
+				: _slot(other._slot)
+				, _version(other._version) {
+			other._slot = nullptr;
+		}
+		snapshot& operator=(snapshot&& other) noexcept {
+			if (this != &other) {
+				release();
+				_slot = other._slot;
+				_version = other._version;
+				other._slot = nullptr;
+			}
+			return *this;
+		}
+		snapshot(const snapshot&) = delete;
+		snapshot& operator=(const snapshot&) = delete;
+
+		~snapshot() {
+			release();
+		}
+
+		// Iterator to the root, pass it to the apis. The snapshot must not be
+		// empty.
+		const_iterator root() const {
+			assert(!empty());
+			return { _version, _version->root };
+		}
+
+		size_t size() const {
+			return _version->size;
+		}
+		bool empty() const {
+			return _version->root == npos;
+		}
+
+		const T& operator[](uint32_t idx) const {
+			return _version->node(idx).value;
+		}
+		uint32_t parent(uint32_t idx) const {
+			return _version->node(idx).parent;
+		}
+
+		// Stops reading, the snapshot may be reclaimed.
+		void release() {
+			if (_slot == nullptr) {
+				return;
+			}
+			_slot->epoch.store(idle_epoch);
+			_slot = nullptr;
+		}
+
+	private:
+		reader_slot* _slot = nullptr;
+		const version* _version = nullptr;
+	};
+
+	// A registered reader, use one per thread.
+	struct reader {
+		reader() = default;
+		reader(versioned_tree* tree, reader_slot* slot)
+				: _tree(tree)
+				, _slot(slot) {
+		}
+		reader(reader&& other) noexcept
+				: _tree(other._tree)
+				, _slot(other._slot) {
+			other._slot = nullptr;
+		}
+		reader& operator=(reader&& other) noexcept {
+			if (this != &other) {
+				unregister();
+				_tree = other._tree;
+				_slot = other._slot;
+				other._slot = nullptr;
+			}
+			return *this;
+		}
+		reader(const reader&) = delete;
+		reader& operator=(const reader&) = delete;
+
+		~reader() {
+			unregister();
+		}
+
+		// Returns a snapshot of the last published version. Lock-free.
+		// The previous snapshot must be released.
+		snapshot read() {
+			assert(_slot->epoch.load() == idle_epoch);
+
+			// Announce the epoch before loading the version. A version
+			// retired after this load is retired in a later epoch, and isn't
+			// reclaimed while the announcement stands.
+			_slot->epoch.store(_tree->_epoch.load());
+			return { _slot, _tree->_current.load() };
+		}
+
+	private:
+		void unregister() {
+			if (_slot == nullptr) {
+				return;
+			}
+			std::lock_guard<std::mutex> lock{ _tree->_readers_mutex };
+			_slot->epoch.store(idle_epoch);
+			_slot->in_use = false;
+			_slot = nullptr;
+		}
+
+		versioned_tree* _tree = nullptr;
+		reader_slot* _slot = nullptr;
+	};
+
+	versioned_tree()
+			: _current(new version{}) {
+	}
+
+	versioned_tree(const versioned_tree&) = delete;
+	versioned_tree& operator=(const versioned_tree&) = delete;
+
+	// No reader may be reading.
+	~versioned_tree() {
+		for (chunk* c : _chunks) {
+			delete c;
+		}
+		for (const chunk* c : _replaced) {
+			delete c;
+		}
+		for (retired& r : _retired) {
+			reclaim(&r);
+		}
+		delete _current.load();
+	}
+
+	// Registers a reader. Readers may be created from any thread.
+	reader make_reader() {
+		std::lock_guard<std::mutex> lock{ _readers_mutex };
+		for (std::unique_ptr<reader_slot>& s : _readers) {
+			if (!s->in_use) {
+				s->in_use = true;
+				return { this, s.get() };
+			}
+		}
+
+		_readers.push_back(std::make_unique<reader_slot>());
+		_readers.back()->in_use = true;
+		return { this, _readers.back().get() };
+	}
+
+	/*
+	 Writer
+	*/
+
+	// Number of nodes in the working copy.
+	size_t size() const {
+		return _size;
+	}
+	bool empty() const {
+		return _root == npos;
+	}
+
+	const T& operator[](uint32_t idx) const {
+		return read_node(idx).value;
+	}
+	uint32_t parent(uint32_t idx) const {
+		return read_node(idx).parent;
+	}
+
+	// Returns the value for writing. Copies its chunk if it is shared with
+	// a published version.
+	T& edit(uint32_t idx) {
+		return write_node(idx).value;
+	}
+
+	// Creates the root. The tree must be empty.
+	uint32_t insert_root(T value) {
+		assert(empty());
+		_root = make_node(std::move(value), npos);
+		return _root;
+	}
+
+	// Inserts value as the last child of parent.
+	uint32_t insert(uint32_t parent, T value) {
+		uint32_t idx = make_node(std::move(value), parent);
+
+		uint32_t last_child = read_node(parent).last_child;
+		if (last_child == npos) {
+			write_node(parent).first_child = idx;
+		} else {
+			write_node(last_child).next_sibling = idx;
+			write_node(idx).prev_sibling = last_child;
+		}
+		write_node(parent).last_child = idx;
+		return idx;
+	}
+
+	// Erases the node and its sub-tree.
+	void erase(uint32_t idx) {
+		if (idx == _root) {
+			_root = npos;
+		} else {
+			unlink(idx);
+		}
+
+		// Free the sub-tree slots. Published versions keep their copy.
+		std::vector<uint32_t> stack{ idx };
+		while (!stack.empty()) {
+			uint32_t current = stack.back();
+			stack.pop_back();
+			_free.push_back(current);
+			--_size;
+
+			for (uint32_t c = read_node(current).first_child; c != npos;
+					c = read_node(c).next_sibling) {
+				stack.push_back(c);
+			}
+		}
+	}
+
+	// Makes the working copy visible to new snapshots. Retires the previous
+	// version, and reclaims the retired versions no reader can see.
+	void publish() {
+		version* v = new version{};
+		v->chunks.assign(_chunks.begin(), _chunks.end());
+		v->root = _root;
+		v->size = _size;
+
+		// Published chunks are shared from now on.
+		std::fill(_owned.begin(), _owned.end(), false);
+
+		const version* old = _current.exchange(v);
+		uint64_t epoch = _epoch.fetch_add(1);
+		_retired.push_back({ epoch, old, std::move(_replaced) });
+		_replaced.clear();
+
+		collect();
+	}
+
+	// Reclaims the retired versions no reader can see. publish calls it,
+	// call it after readers release their snapshots to reclaim sooner.
+	// Returns the number of reclaimed versions.
+	size_t collect() {
+		uint64_t min_epoch = idle_epoch;
+		{
+			std::lock_guard<std::mutex> lock{ _readers_mutex };
+			for (const std::unique_ptr<reader_slot>& s : _readers) {
+				min_epoch = (std::min)(min_epoch, s->epoch.load());
+			}
+		}
+
+		// Retired in order, oldest first.
+		size_t num_reclaimed = 0;
+		while (num_reclaimed < _retired.size()
+				&& _retired[num_reclaimed].epoch < min_epoch) {
+			reclaim(&_retired[num_reclaimed]);
+			++num_reclaimed;
+		}
+		_retired.erase(_retired.begin(), _retired.begin() + num_reclaimed);
+		return num_reclaimed;
+	}
+
+	// Number of retired versions waiting for readers.
+	size_t num_retired() const {
+		return _retired.size();
+	}
+
+private:
+	struct retired {
+		uint64_t epoch;
+		const version* v;
+		std::vector<const chunk*> chunks;
+	};
+
+	static void reclaim(retired* r) {
+		for (const chunk* c : r->chunks) {
+			delete c;
+		}
+		r->chunks.clear();
+		delete r->v;
+		r->v = nullptr;
+	}
+
+	void unlink(uint32_t idx) {
+		node n = read_node(idx);
+		if (n.prev_sibling == npos) {
+			write_node(n.parent).first_child = n.next_sibling;
+		} else {
+			write_node(n.prev_sibling).next_sibling = n.next_sibling;
+		}
+		if (n.next_sibling == npos) {
+			write_node(n.parent).last_child = n.prev_sibling;
+		} else {
+			write_node(n.next_sibling).prev_sibling = n.prev_sibling;
+		}
+	}
+
+	const node& read_node(uint32_t idx) const {
+		return _chunks[idx >> detail::vtree_chunk_shift]
+				->nodes[idx & detail::vtree_chunk_mask];
+	}
+
+	// Copies the chunk on its first write since the last publish.
+	chunk* own_chunk(size_t chunk_idx) {
+		if (!_owned[chunk_idx]) {
+			_replaced.push_back(_chunks[chunk_idx]);
+			_chunks[chunk_idx] = new chunk(*_chunks[chunk_idx]);
+			_owned[chunk_idx] = true;
+		}
+		return _chunks[chunk_idx];
+	}
+
+	node& write_node(uint32_t idx) {
+		return own_chunk(idx >> detail::vtree_chunk_shift)
+				->nodes[idx & detail::vtree_chunk_mask];
+	}
+
+	uint32_t make_node(T&& value, uint32_t parent) {
+		++_size;
+		if (!_free.empty()) {
+			uint32_t idx = _free.back();
+			_free.pop_back();
+			write_node(idx) = node{ std::move(value), parent };
+			return idx;
+		}
+
+		uint32_t idx = _capacity++;
+		if ((idx & detail::vtree_chunk_mask) == 0) {
+			_chunks.push_back(new chunk{});
+			_chunks.back()->nodes.reserve(detail::vtree_chunk_size);
+			_owned.push_back(true);
+		}
+
+		own_chunk(_chunks.size() - 1)
+				->nodes.push_back(node{ std::move(value), parent });
+		return idx;
+	}
+
+	// Working copy.
+	std::vector<chunk*> _chunks;
+	// Chunks written since the last publish, readers never see them.
+	std::vector<bool> _owned;
+	// Shared chunks copied since the last publish.
+	std::vector<const chunk*> _replaced;
+	std::vector<uint32_t> _free;
+	uint32_t _root = npos;
+	uint32_t _capacity = 0;
+	size_t _size = 0;
+
+	// Published.
+	std::atomic<const version*> _current;
+	std::atomic<uint64_t> _epoch{ 0 };
+	std::vector<retired> _retired;
+
+	std::mutex _readers_mutex;
+	std::vector<std::unique_ptr<reader_slot>> _readers;
+};
+
+template <class T>
+constexpr uint32_t versioned_tree<T>::npos;
+template <class T>
+constexpr uint64_t versioned_tree<T>::idle_epoch;
+
+// Found through ADL.
+template <class T, class StatePtr>
+inline std::pair<versioned_tree_iterator<T>, versioned_tree_iterator<T>>
+children_range(versioned_tree_iterator<T> parent, StatePtr*) {
+	return { { parent.version(),
+					 parent.version()->node(parent.index()).first_child },
+		{ parent.version(), detail::vtree_npos } };
+}
+} // namespace fea
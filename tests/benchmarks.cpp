@@ -5,6 +5,7 @@
 #include <chrono>
 #include <fea_benchmark/fea_benchmark.hpp>
 #include <fea_flat_recurse/fea_flat_recurse.hpp>
+#include <fea_flat_recurse/relayout.hpp>
 #include <gtest/gtest.h>
 #include <random>
 #include <thread>
@@ -297,6 +298,71 @@ TEST(flat_recurse, wide_gather_benchmarks) {
 		suite.print();
 	}
 }
+
+TEST(flat_recurse, relayout_benchmarks) {
+	using namespace deep;
+	using namespace std::chrono_literals;
+	small_obj root{ nullptr };
+	root.create_graph(depth, width);
+
+	auto node_func = [](small_obj* node) { return node->disabled; };
+	auto depth_tree
+			= fea::relayout(&root, fea::layout_order::depthfirst, node_func);
+	auto breadth_tree
+			= fea::relayout(&root, fea::layout_order::breadthfirst, node_func);
+	auto veb_tree
+			= fea::relayout(&root, fea::layout_order::van_emde_boas, node_func);
+
+	std::string title = "Traverse Small Objects Before And After Relayout - "
+			+ std::to_string(depth) + " deep, " + std::to_string(width)
+			+ " wide, " + std::to_string(num_nodes) + " nodes";
+
+	size_t num_disabled = 0;
+	size_t expected_disabled = 0;
+	fea::for_each_depthfirst_flat(&root,
+			[&](small_obj* node) { expected_disabled += node->disabled; });
+
+	fea::bench::suite suite;
+	suite.title(title.c_str());
+	suite.average(5);
+
+	if (sleep_between) {
+		suite.sleep_between(500ms);
+	}
+
+	auto check = [&]() {
+		EXPECT_EQ(num_disabled, expected_disabled);
+		num_disabled = 0;
+	};
+
+	suite.benchmark(
+			"original (depth)",
+			[&]() {
+				fea::for_each_depthfirst_flat(&root, [&](small_obj* node) {
+					num_disabled += node->disabled;
+				});
+			},
+			check);
+
+	auto bench_tree = [&](const char* name, const auto& tree) {
+		using iter_t = typename std::decay_t<decltype(tree)>::iter;
+		suite.benchmark(
+				name,
+				[&]() {
+					fea::for_each_depthfirst_flat(
+							tree.root(),
+							[&](iter_t it) { num_disabled += tree[it]; },
+							&tree);
+				},
+				check);
+	};
+
+	bench_tree("relayout depthfirst (depth)", depth_tree);
+	bench_tree("relayout breadthfirst (depth)", breadth_tree);
+	bench_tree("relayout van emde boas (depth)", veb_tree);
+
+	suite.print();
+}
 } // namespace
 
 #endif // NDEBUG
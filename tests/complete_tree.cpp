@@ -0,0 +1,169 @@
+﻿#include "global.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <fea_flat_recurse/complete_tree.hpp>
+#include <fea_flat_recurse/fea_flat_recurse.hpp>
+#include <gtest/gtest.h>
+#include <numeric>
+#include <vector>
+
+namespace {
+std::vector<uint32_t> to_indices(
+		const std::vector<fea::complete_tree_iterator>& its) {
+	std::vector<uint32_t> ret;
+	for (fea::complete_tree_iterator it : its) {
+		ret.push_back(*it);
+	}
+	return ret;
+}
+
+void test_complete_tree(const fea::complete_tree& tree) {
+	using iter_t = fea::complete_tree_iterator;
+	auto no_cull = [](iter_t) { return false; };
+
+	SCOPED_TRACE("complete_tree test breadth");
+	test_breadth(tree.root());
+
+	SCOPED_TRACE("complete_tree test depth");
+	test_depth(tree.root());
+
+	auto cull_pred = [](iter_t it) { return (*it % 7) == 3; };
+	auto parent_cull_pred = [&](iter_t it) {
+		if (*it == 0) {
+			return cull_pred(it);
+		}
+		return cull_pred(tree.node(tree.parent(*it)));
+	};
+
+	SCOPED_TRACE("complete_tree test cull");
+	test_culling(tree.root(), cull_pred, parent_cull_pred);
+
+	SCOPED_TRACE("complete_tree test stackless");
+	test_stackless(tree.root(), cull_pred);
+
+	// Breadth-first order is index order.
+	std::vector<iter_t> out;
+	fea::gather_breadthfirst(tree.root(), &out);
+	std::vector<uint32_t> ref(tree.size());
+	std::iota(ref.begin(), ref.end(), 0u);
+	EXPECT_EQ(to_indices(out), ref);
+
+	// Index ranges match the traversals, for sub-trees too.
+	std::vector<std::vector<iter_t>> staged;
+	std::vector<std::vector<iter_t>> staged_ref;
+	std::vector<iter_t> ref_out;
+	for (uint32_t idx : { 0u, 1u, 2u, 5u, uint32_t(tree.size() - 1) }) {
+		if (idx >= tree.size()) {
+			continue;
+		}
+
+		fea::gather_breadthfirst(tree.node(idx), &out);
+		fea::gather_breadthfirst(tree.node(idx), no_cull, &ref_out);
+		EXPECT_EQ(to_indices(out), to_indices(ref_out));
+
+		fea::gather_breadthfirst_staged(tree.node(idx), &staged);
+		fea::gather_breadthfirst_staged(tree.node(idx), no_cull, &staged_ref);
+		ASSERT_EQ(staged.size(), staged_ref.size());
+		for (size_t i = 0; i < staged.size(); ++i) {
+			EXPECT_EQ(to_indices(staged[i]), to_indices(staged_ref[i]));
+		}
+	}
+
+	std::vector<std::pair<uint32_t, uint32_t>> levels;
+	tree.levels(&levels);
+	EXPECT_EQ(levels.front().first, 0u);
+	EXPECT_EQ(levels.back().second, tree.size());
+	for (size_t i = 1; i < levels.size(); ++i) {
+		EXPECT_EQ(levels[i].first, levels[i - 1].second);
+	}
+}
+
+TEST(flat_recurse, complete_tree) {
+	// Full last level.
+	test_complete_tree(fea::complete_tree{ 5, 3906 });
+
+	// Partial last level.
+	test_complete_tree(fea::complete_tree{ 3, 1000 });
+	test_complete_tree(fea::complete_tree{ 2, 100 });
+
+	// Chain.
+	test_complete_tree(fea::complete_tree{ 1, 50 });
+
+	// Single node.
+	test_complete_tree(fea::complete_tree{ 4, 1 });
+
+	fea::complete_tree tree{ 3, 1000 };
+	std::vector<std::pair<uint32_t, uint32_t>> levels;
+	tree.levels(&levels);
+	std::vector<std::pair<uint32_t, uint32_t>> ref{ { 0, 1 }, { 1, 4 },
+		{ 4, 13 }, { 13, 40 }, { 40, 121 }, { 121, 364 }, { 364, 1000 } };
+	EXPECT_EQ(levels, ref);
+
+	tree.subtree_levels(2, &levels);
+	ref = { { 2, 3 }, { 7, 10 }, { 22, 31 }, { 67, 94 }, { 202, 283 },
+		{ 607, 850 } };
+	EXPECT_EQ(levels, ref);
+
+	// Too deep to recurse.
+	fea::complete_tree chain{ 1, 1'000'000 };
+	uint32_t next = 0;
+	fea::for_each_depthfirst_hybrid(
+			chain.root(), [&](fea::complete_tree_iterator it) {
+				EXPECT_EQ(*it, next);
+				++next;
+			});
+	EXPECT_EQ(next, chain.size());
+}
+
+TEST(flat_recurse, complete_tree_find_par) {
+	using iter_t = fea::complete_tree_iterator;
+	fea::work_stealing_pool pool{ 4 };
+
+	// A chain never gets wide, splitting stops at a fixed depth.
+	fea::complete_tree chain{ 1, 1'000'000 };
+	std::atomic<size_t> num_tests{ 0 };
+	uint32_t target = 0;
+	auto pred = [&](iter_t it) {
+		++num_tests;
+		return *it == target;
+	};
+
+	// A match at the root is found without walking the tree.
+	iter_t found;
+	EXPECT_TRUE(fea::find_if_depthfirst_par(pool, chain.root(), pred, &found));
+	EXPECT_EQ(*found, 0u);
+	EXPECT_EQ(num_tests.load(), 1u);
+
+	num_tests = 0;
+	EXPECT_TRUE(fea::any_of_par(pool, chain.root(), pred));
+	EXPECT_EQ(num_tests.load(), 1u);
+
+	for (uint32_t t : { 5u, 31u, 32u, 33u, 900'000u, 999'999u }) {
+		target = t;
+		EXPECT_TRUE(
+				fea::find_if_depthfirst_par(pool, chain.root(), pred, &found));
+		EXPECT_EQ(*found, t);
+		EXPECT_TRUE(fea::find_if_depthfirst_par(
+				pool, chain.root(), pred, &found, (const void*)nullptr, false));
+		EXPECT_EQ(*found, t);
+	}
+
+	target = uint32_t(chain.size());
+	EXPECT_FALSE(fea::find_if_depthfirst_par(pool, chain.root(), pred, &found));
+	EXPECT_FALSE(fea::any_of_par(pool, chain.root(), pred));
+
+	// A match while splitting, ordered mode searches the preceding sub-trees
+	// first. Index 3's sub-tree precedes index 2 in depth-first order.
+	fea::complete_tree tree{ 2, 100'000 };
+	std::vector<iter_t> ref;
+	fea::gather_depthfirst(tree.root(), &ref);
+	auto many_pred = [](iter_t it) { return *it == 2 || *it % 1000 == 999; };
+	auto ref_it = std::find_if(ref.begin(), ref.end(), many_pred);
+	ASSERT_NE(ref_it, ref.end());
+	EXPECT_NE(**ref_it, 2u);
+	EXPECT_TRUE(
+			fea::find_if_depthfirst_par(pool, tree.root(), many_pred, &found));
+	EXPECT_EQ(found, *ref_it);
+}
+} // namespace
@@ -1,6 +1,8 @@
 ﻿#include "global.hpp"
 
+#include <algorithm>
 #include <fea_flat_recurse/fea_flat_recurse.hpp>
+#include <forward_list>
 #include <gtest/gtest.h>
 #include <list>
 #include <unordered_map>
@@ -58,6 +60,51 @@ struct list_node {
 	list_node* parent = nullptr;
 	bool disabled = false;
 };
+
+struct fwd_list_node {
+	using iter = typename std::forward_list<fwd_list_node>::iterator;
+	using citer = typename std::forward_list<fwd_list_node>::const_iterator;
+
+	fwd_list_node(fwd_list_node* p)
+			: parent(p) {
+	}
+
+	void create_graph(const size_t max_depth, const size_t num_children,
+			const size_t depth = 0) {
+		if (depth == max_depth - 1)
+			return;
+
+		++disable_counter;
+		disabled = disable_counter % 6 == 0;
+
+		for (size_t i = 0; i < num_children; ++i) {
+			children.push_front({ this });
+			children.front().create_graph(max_depth, num_children, depth + 1);
+		}
+	}
+
+	citer begin() const {
+		return children.begin();
+	}
+	iter begin() {
+		return children.begin();
+	}
+
+	citer end() const {
+		return children.end();
+	}
+	iter end() {
+		return children.end();
+	}
+
+	bool operator==(const fwd_list_node& other) const {
+		return this == &other;
+	}
+
+	std::forward_list<fwd_list_node> children;
+	fwd_list_node* parent = nullptr;
+	bool disabled = false;
+};
 } // namespace
 
 // gcc unordered_map implementation doesn't work here.
@@ -170,6 +217,180 @@ TEST(flat_recurse, list_iters) {
 	}
 }
 
+TEST(flat_recurse, forward_list_iters) {
+	std::forward_list<fwd_list_node> root_vec;
+	root_vec.push_front({ nullptr });
+	root_vec.front().create_graph(6, 8);
+
+	auto root_it = root_vec.begin();
+
+	SCOPED_TRACE("fwd_list_node test breadth");
+	test_breadth(root_it);
+
+	SCOPED_TRACE("fwd_list_node test depth");
+	test_depth(root_it);
+
+	// cull disabled
+	{
+		auto cull_pred = [](auto node) { return node->disabled; };
+		auto parent_cull_pred = [=](auto node) {
+			if (node->parent == nullptr) {
+				return cull_pred(node);
+			}
+			return cull_pred(node->parent);
+		};
+
+		root_vec.front().disabled = false;
+		SCOPED_TRACE("fwd_list_node test cull disabled");
+		test_culling(root_it, cull_pred, parent_cull_pred);
+	}
+
+	// cull enabled
+	{
+		auto cull_pred = [](auto node) { return node->disabled == false; };
+		auto parent_cull_pred = [=](auto node) {
+			if (node->parent == nullptr) {
+				return cull_pred(node);
+			}
+			return cull_pred(node->parent);
+		};
+
+		root_vec.front().disabled = true;
+		SCOPED_TRACE("fwd_list_node test cull enabled");
+		test_culling(root_it, cull_pred, parent_cull_pred);
+	}
+}
+
+TEST(flat_recurse, list_forest) {
+	std::list<list_node> roots;
+	for (size_t i = 0; i < 20; ++i) {
+		roots.push_back({ nullptr });
+		roots.back().create_graph(4, i % 4 + 1);
+	}
+
+	auto cull_pred = [](auto node) { return node->disabled; };
+	using iter_t = std::list<list_node>::iterator;
+
+	for (bool cull : { false, true }) {
+		auto pred = [&](iter_t node) { return cull && cull_pred(node); };
+
+		// Reference, one call per root.
+		std::vector<iter_t> ref;
+		std::vector<size_t> ref_offsets;
+		std::vector<iter_t> breadth_ref_roots;
+		size_t breadth_ref_size = 0;
+		for (auto it = roots.begin(); it != roots.end(); ++it) {
+			ref_offsets.push_back(ref.size());
+
+			std::vector<iter_t> root_out;
+			fea::gather_depthfirst_flat(it, pred, &root_out);
+			ref.insert(ref.end(), root_out.begin(), root_out.end());
+
+			fea::gather_breadthfirst(it, pred, &root_out);
+			breadth_ref_size += root_out.size();
+			if (!pred(it)) {
+				breadth_ref_roots.push_back(it);
+			}
+		}
+		ref_offsets.push_back(ref.size());
+
+		std::vector<iter_t> out;
+		std::vector<size_t> offsets;
+		fea::gather_depthfirst_forest(
+				roots.begin(), roots.end(), pred, &out, &offsets);
+		EXPECT_EQ(out, ref);
+		EXPECT_EQ(offsets, ref_offsets);
+
+		fea::gather_depthfirst_forest(
+				roots.begin(), roots.end(), pred, &out, nullptr);
+		EXPECT_EQ(out, ref);
+
+		fea::gather_depthfirst_forest_par(
+				roots.begin(), roots.end(), pred, &out, &offsets);
+		EXPECT_EQ(out, ref);
+		EXPECT_EQ(offsets, ref_offsets);
+
+		for (size_t num_threads : { 1, 3, 8, 64 }) {
+			fea::work_stealing_pool pool{ num_threads };
+			fea::gather_depthfirst_forest_par(
+					pool, roots.begin(), roots.end(), pred, &out, &offsets);
+			EXPECT_EQ(out, ref);
+			EXPECT_EQ(offsets, ref_offsets);
+		}
+
+		{
+			fea::work_stealing_pool pool{ 4 };
+			fea::gather_depthfirst_forest_par(
+					pool, roots.begin(), roots.end(), pred, &out, &offsets);
+			EXPECT_EQ(out, ref);
+			EXPECT_EQ(offsets, ref_offsets);
+
+			fea::inline_executor inline_ex;
+			fea::gather_depthfirst_forest_par(inline_ex, roots.begin(),
+					roots.end(), pred, &out, &offsets);
+			EXPECT_EQ(out, ref);
+			EXPECT_EQ(offsets, ref_offsets);
+		}
+
+		out.clear();
+		fea::for_each_depthfirst_forest(
+				roots.begin(), roots.end(),
+				[&](iter_t node) { out.push_back(node); }, pred);
+		EXPECT_EQ(out, ref);
+
+		fea::gather_breadthfirst_forest(roots.begin(), roots.end(), pred, &out);
+		EXPECT_EQ(out.size(), breadth_ref_size);
+		EXPECT_TRUE(std::equal(breadth_ref_roots.begin(),
+				breadth_ref_roots.end(), out.begin()));
+
+		std::vector<std::vector<iter_t>> staged_out;
+		fea::gather_breadthfirst_staged_forest(
+				roots.begin(), roots.end(), pred, &staged_out);
+		ASSERT_FALSE(staged_out.empty());
+		EXPECT_EQ(staged_out.front(), breadth_ref_roots);
+
+		size_t staged_size = 0;
+		for (const std::vector<iter_t>& v : staged_out) {
+			staged_size += v.size();
+		}
+		EXPECT_EQ(staged_size, breadth_ref_size);
+	}
+
+	// Without cull predicate.
+	{
+		std::vector<iter_t> ref;
+		std::vector<iter_t> out;
+		std::vector<size_t> offsets;
+		for (auto it = roots.begin(); it != roots.end(); ++it) {
+			std::vector<iter_t> root_out;
+			fea::gather_depthfirst_flat(it, &root_out);
+			ref.insert(ref.end(), root_out.begin(), root_out.end());
+		}
+
+		fea::gather_depthfirst_forest(
+				roots.begin(), roots.end(), &out, &offsets);
+		EXPECT_EQ(out, ref);
+		EXPECT_EQ(offsets.size(), roots.size() + 1);
+
+		fea::gather_depthfirst_forest_par(
+				roots.begin(), roots.end(), &out, &offsets);
+		EXPECT_EQ(out, ref);
+		EXPECT_EQ(offsets.size(), roots.size() + 1);
+
+		fea::work_stealing_pool pool{ 2 };
+		fea::gather_depthfirst_forest_par(
+				pool, roots.begin(), roots.end(), &out, &offsets);
+		EXPECT_EQ(out, ref);
+		EXPECT_EQ(offsets.size(), roots.size() + 1);
+
+		// Empty forest.
+		fea::gather_depthfirst_forest(
+				roots.end(), roots.end(), &out, &offsets);
+		EXPECT_TRUE(out.empty());
+		EXPECT_EQ(offsets, std::vector<size_t>{ 0 });
+	}
+}
+
 #if !defined(GCC_COMPILER)
 TEST(flat_recurse, umap_iters) {
 	umap_node n{ nullptr };
@@ -0,0 +1,223 @@
+﻿#include "global.hpp"
+
+#include <cstdint>
+#include <fea_flat_recurse/fea_flat_recurse.hpp>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+namespace {
+// Nodes are shared between parents, the graph is a DAG.
+struct dag_node {
+	size_t id = 0;
+	std::vector<dag_node*> children;
+};
+
+// Every node is a child of all the nodes of the previous layer.
+// Without visited tracking, the number of paths is width^num_layers.
+std::vector<dag_node> make_layered_dag(size_t num_layers, size_t width) {
+	std::vector<dag_node> ret(1 + num_layers * width);
+	for (size_t i = 0; i < ret.size(); ++i) {
+		ret[i].id = i;
+	}
+
+	for (size_t i = 0; i < width; ++i) {
+		ret[0].children.push_back(&ret[1 + i]);
+	}
+
+	for (size_t l = 0; l + 1 < num_layers; ++l) {
+		for (size_t i = 0; i < width; ++i) {
+			dag_node& parent = ret[1 + l * width + i];
+			for (size_t j = 0; j < width; ++j) {
+				parent.children.push_back(&ret[1 + (l + 1) * width + j]);
+			}
+		}
+	}
+	return ret;
+}
+} // namespace
+
+namespace fea {
+template <>
+inline std::pair<dag_node**, dag_node**> children_range(
+		dag_node** parent, const void*) {
+	std::vector<dag_node*>& children = (*parent)->children;
+	if (children.empty()) {
+		return { nullptr, nullptr };
+	}
+	return { children.data(), children.data() + children.size() };
+}
+} // namespace fea
+
+namespace {
+// Checks every non-culled node is visited exactly once.
+template <class CullPred>
+void check_visited_once(const std::vector<dag_node>& nodes,
+		const std::vector<dag_node**>& visited, CullPred cull_pred) {
+	std::vector<size_t> counts(nodes.size(), 0);
+	for (dag_node** it : visited) {
+		++counts[(*it)->id];
+	}
+
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		dag_node* n = const_cast<dag_node*>(&nodes[i]);
+		size_t expected = cull_pred(&n) ? 0 : 1;
+		EXPECT_EQ(counts[i], expected);
+	}
+}
+
+template <class MakeVisited, class CullPred>
+void test_dag(std::vector<dag_node>& nodes, MakeVisited make_visited,
+		CullPred cull_pred) {
+	dag_node* root = &nodes[0];
+	dag_node** root_it = &root;
+
+	std::vector<dag_node**> out;
+	{
+		auto visited = make_visited();
+		fea::gather_depthfirst(
+				root_it, &out, fea::make_visited_cull(&visited, cull_pred));
+		check_visited_once(nodes, out, cull_pred);
+	}
+	{
+		auto visited = make_visited();
+		fea::gather_depthfirst_flat(
+				root_it, fea::make_visited_cull(&visited, cull_pred), &out);
+		check_visited_once(nodes, out, cull_pred);
+	}
+	{
+		auto visited = make_visited();
+		fea::gather_breadthfirst(
+				root_it, fea::make_visited_cull(&visited, cull_pred), &out);
+		check_visited_once(nodes, out, cull_pred);
+	}
+	{
+		auto visited = make_visited();
+		std::vector<std::vector<dag_node**>> staged_out;
+		fea::gather_breadthfirst_staged(root_it,
+				fea::make_visited_cull(&visited, cull_pred), &staged_out);
+
+		out.clear();
+		for (const std::vector<dag_node**>& v : staged_out) {
+			out.insert(out.end(), v.begin(), v.end());
+		}
+		check_visited_once(nodes, out, cull_pred);
+	}
+	{
+		auto visited = make_visited();
+		out.clear();
+		fea::for_each_depthfirst_flat(
+				root_it, [&](dag_node** it) { out.push_back(it); },
+				fea::make_visited_cull(&visited, cull_pred));
+		check_visited_once(nodes, out, cull_pred);
+	}
+	{
+		auto visited = make_visited();
+		out.clear();
+		fea::for_each_breadthfirst(
+				root_it, [&](dag_node** it) { out.push_back(it); },
+				fea::make_visited_cull(&visited, cull_pred));
+		check_visited_once(nodes, out, cull_pred);
+	}
+}
+
+TEST(flat_recurse, dag_visited) {
+	// 8^40 paths, only 321 nodes.
+	std::vector<dag_node> nodes = make_layered_dag(40, 8);
+
+	auto id_func = [](dag_node** it) { return (*it)->id; };
+	auto key_func = [](dag_node** it) {
+		return reinterpret_cast<std::uintptr_t>(*it);
+	};
+
+	auto make_bitset = [&]() {
+		return fea::make_visited_bitset(nodes.size(), id_func);
+	};
+	auto make_hashset = [&]() { return fea::make_visited_hashset(key_func); };
+
+	auto no_cull = [](dag_node**) { return false; };
+	auto cull_some = [](dag_node** it) {
+		return (*it)->id != 0 && (*it)->id % 5 == 4;
+	};
+
+	SCOPED_TRACE("dag bitset");
+	test_dag(nodes, make_bitset, no_cull);
+	test_dag(nodes, make_bitset, cull_some);
+
+	SCOPED_TRACE("dag hashset");
+	test_dag(nodes, make_hashset, no_cull);
+	test_dag(nodes, make_hashset, cull_some);
+
+	// Without cull predicate.
+	{
+		dag_node* root = &nodes[0];
+		auto visited = make_bitset();
+		std::vector<dag_node**> out;
+		fea::gather_depthfirst_flat(
+				&root, fea::make_visited_cull(&visited), &out);
+		check_visited_once(nodes, out, no_cull);
+	}
+}
+
+TEST(flat_recurse, visited_hashset) {
+	std::vector<size_t> keys(10000);
+	for (size_t i = 0; i < keys.size(); ++i) {
+		keys[i] = i * 4096;
+	}
+	// Out-of-band sentinel.
+	keys.back() = size_t(-1);
+
+	auto key_func = [](const size_t* it) { return *it; };
+	fea::visited_hashset<decltype(key_func)> visited(key_func);
+
+	for (const size_t& k : keys) {
+		EXPECT_FALSE(visited.test_and_set(&k));
+	}
+	for (const size_t& k : keys) {
+		EXPECT_TRUE(visited.test_and_set(&k));
+	}
+
+	visited.clear();
+	EXPECT_FALSE(visited.test_and_set(&keys.back()));
+	EXPECT_FALSE(visited.test_and_set(&keys.front()));
+}
+
+TEST(flat_recurse, visited_bitset_atomic) {
+	constexpr size_t num_ids = 1000;
+	constexpr size_t num_threads = 4;
+
+	std::vector<size_t> ids(num_ids);
+	for (size_t i = 0; i < num_ids; ++i) {
+		ids[i] = i;
+	}
+
+	auto id_func = [](const size_t* it) { return *it; };
+	fea::visited_bitset_atomic<decltype(id_func)> visited(num_ids, id_func);
+
+	// Every thread tries to mark every node, only one must succeed.
+	std::vector<std::vector<size_t>> won(num_threads);
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < num_threads; ++t) {
+		threads.emplace_back([&, t]() {
+			for (const size_t& id : ids) {
+				if (!visited.test_and_set(&id)) {
+					won[t].push_back(id);
+				}
+			}
+		});
+	}
+	for (std::thread& t : threads) {
+		t.join();
+	}
+
+	std::vector<size_t> counts(num_ids, 0);
+	for (const std::vector<size_t>& v : won) {
+		for (size_t id : v) {
+			++counts[id];
+		}
+	}
+	for (size_t c : counts) {
+		EXPECT_EQ(c, 1u);
+	}
+}
+} // namespace
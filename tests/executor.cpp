@@ -0,0 +1,104 @@
+﻿#include <atomic>
+#include <fea_flat_recurse/fea_flat_recurse.hpp>
+#include <functional>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+namespace {
+// A minimal third party pool, one thread per task.
+struct spawning_pool {
+	~spawning_pool() {
+		std::lock_guard<std::mutex> lock{ mutex };
+		for (std::thread& t : threads) {
+			t.join();
+		}
+	}
+
+	void submit(std::function<void()> task) {
+		std::lock_guard<std::mutex> lock{ mutex };
+		threads.emplace_back(std::move(task));
+	}
+
+	std::mutex mutex;
+	std::vector<std::thread> threads;
+};
+
+template <class Executor>
+void test_executor(Executor& executor) {
+	// bulk
+	{
+		std::vector<size_t> out(1000, 0);
+		executor.bulk(out.size(), [&](size_t i) { out[i] = i; });
+
+		std::vector<size_t> ref(out.size());
+		std::iota(ref.begin(), ref.end(), size_t(0));
+		EXPECT_EQ(out, ref);
+
+		// Nothing to do.
+		executor.bulk(0, [](size_t) { ADD_FAILURE(); });
+	}
+
+	// Nested bulk.
+	{
+		std::atomic<size_t> count{ 0 };
+		executor.bulk(16, [&](size_t) {
+			executor.bulk(16, [&](size_t) { ++count; });
+		});
+		EXPECT_EQ(count.load(), 256u);
+	}
+
+	// submit
+	{
+		std::atomic<size_t> count{ 0 };
+		std::vector<size_t> ids(64);
+		executor.bulk(ids.size(), [&](size_t i) {
+			executor.submit([&]() { ++count; });
+			ids[i] = i;
+		});
+
+		while (count.load() != ids.size()) {
+			std::this_thread::yield();
+		}
+	}
+
+	EXPECT_GE(executor.concurrency(), 1u);
+}
+
+TEST(flat_recurse, executors) {
+	{
+		fea::inline_executor executor;
+		test_executor(executor);
+		EXPECT_EQ(executor.concurrency(), 1u);
+	}
+
+	for (size_t num_threads : { 1, 2, 4, 0 }) {
+		fea::work_stealing_pool pool{ num_threads };
+		test_executor(pool);
+		if (num_threads != 0) {
+			EXPECT_EQ(pool.concurrency(), num_threads);
+		}
+	}
+
+	{
+		spawning_pool pool;
+		auto executor = fea::make_executor_adapter(&pool, 4);
+		test_executor(executor);
+		EXPECT_EQ(executor.concurrency(), 4u);
+	}
+
+	// Queued tasks run before the pool is destroyed.
+	{
+		std::atomic<size_t> count{ 0 };
+		{
+			fea::work_stealing_pool pool{ 2 };
+			for (size_t i = 0; i < 100; ++i) {
+				pool.submit([&]() { ++count; });
+			}
+		}
+		EXPECT_EQ(count.load(), 100u);
+	}
+}
+} // namespace
@@ -0,0 +1,244 @@
+﻿#include "global.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fea_flat_recurse/fea_flat_recurse.hpp>
+#include <fea_flat_recurse/flat_tree.hpp>
+#include <gtest/gtest.h>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace {
+// Values are unique ids.
+void create_graph(fea::flat_tree<size_t>* tree, uint32_t parent,
+		size_t max_depth, size_t num_children, size_t depth = 0) {
+	if (depth == max_depth - 1)
+		return;
+
+	for (size_t i = 0; i < num_children; ++i) {
+		uint32_t idx = tree->insert(parent, tree->size());
+		create_graph(tree, idx, max_depth, num_children, depth + 1);
+	}
+}
+
+template <class Tree>
+void test_flat_tree(Tree& tree) {
+	using iter_t = decltype(tree.root());
+
+	SCOPED_TRACE("flat_tree test breadth");
+	test_breadth(tree.root());
+
+	SCOPED_TRACE("flat_tree test depth");
+	test_depth(tree.root());
+
+	auto cull_pred = [](iter_t it) { return (*it % 7) == 3; };
+	auto parent_cull_pred = [&](iter_t it) {
+		uint32_t parent = tree.parent(it.index());
+		if (parent == fea::flat_tree<size_t>::npos) {
+			return cull_pred(it);
+		}
+		return cull_pred(iter_t{ &tree, parent });
+	};
+
+	SCOPED_TRACE("flat_tree test cull");
+	test_culling(tree.root(), cull_pred, parent_cull_pred);
+
+	SCOPED_TRACE("flat_tree test stackless");
+	test_stackless(tree.root(), cull_pred);
+}
+
+TEST(flat_recurse, flat_tree) {
+	fea::flat_tree<size_t> tree;
+	EXPECT_TRUE(tree.empty());
+	tree.insert_root(0);
+	create_graph(&tree, 0, 6, 5);
+	EXPECT_EQ(tree.size(), 3906u);
+
+	test_flat_tree(tree);
+
+	const fea::flat_tree<size_t>& ctree = tree;
+	test_flat_tree(ctree);
+}
+
+TEST(flat_recurse, flat_tree_erase_compact) {
+	fea::flat_tree<size_t> tree;
+	uint32_t root = tree.insert_root(0);
+	uint32_t a = tree.insert(root, 1);
+	uint32_t b = tree.insert(root, 2);
+	uint32_t c = tree.insert(root, 3);
+	tree.insert(a, 4);
+	uint32_t b0 = tree.insert(b, 5);
+	tree.insert(b0, 6);
+	tree.insert(c, 7);
+	EXPECT_EQ(tree.size(), 8u);
+
+	auto gather_values = [&]() {
+		std::vector<size_t> ret;
+		fea::for_each_depthfirst_flat(tree.root(),
+				[&](fea::flat_tree<size_t>::iterator it) {
+					ret.push_back(*it);
+				});
+		return ret;
+	};
+	EXPECT_EQ(gather_values(), std::vector<size_t>({ 0, 1, 4, 2, 5, 6, 3, 7 }));
+
+	// Middle sibling and its sub-tree.
+	tree.erase(b);
+	EXPECT_EQ(tree.size(), 5u);
+	EXPECT_EQ(tree.free_size(), 3u);
+	EXPECT_EQ(gather_values(), std::vector<size_t>({ 0, 1, 4, 3, 7 }));
+
+	// Slots are reused.
+	uint32_t d = tree.insert(c, 8);
+	EXPECT_LT(d, 8u);
+	EXPECT_EQ(tree.free_size(), 2u);
+	EXPECT_EQ(gather_values(), std::vector<size_t>({ 0, 1, 4, 3, 7, 8 }));
+
+	// First and last sibling.
+	tree.erase(a);
+	tree.erase(tree.first_child(c));
+	EXPECT_EQ(gather_values(), std::vector<size_t>({ 0, 3, 8 }));
+
+	// Compaction stores the nodes depth-first.
+	std::vector<uint32_t> new_idxes = tree.compact();
+	EXPECT_EQ(tree.free_size(), 0u);
+	EXPECT_EQ(tree.size(), 3u);
+	EXPECT_EQ(new_idxes[root], 0u);
+	EXPECT_EQ(new_idxes[c], 1u);
+	EXPECT_EQ(new_idxes[d], 2u);
+	EXPECT_EQ(new_idxes[a], fea::flat_tree<size_t>::npos);
+	EXPECT_EQ(tree[2], 8u);
+	EXPECT_EQ(tree.parent(2), 1u);
+	EXPECT_EQ(gather_values(), std::vector<size_t>({ 0, 3, 8 }));
+
+	tree.erase(0);
+	EXPECT_TRUE(tree.empty());
+	EXPECT_EQ(tree.size(), 0u);
+}
+
+// Interval hierarchy over sorted points, leaves hold a single point.
+void create_intervals(fea::flat_tree<std::pair<double, double>>* tree,
+		uint32_t parent, const double* first, const double* last) {
+	size_t size = size_t(last - first);
+	if (size == 1) {
+		return;
+	}
+
+	const double* mid = first + size / 2;
+	uint32_t lhs = tree->insert(parent, { *first, *(mid - 1) });
+	create_intervals(tree, lhs, first, mid);
+	uint32_t rhs = tree->insert(parent, { *mid, *(last - 1) });
+	create_intervals(tree, rhs, mid, last);
+}
+
+TEST(flat_recurse, flat_tree_bestfirst) {
+	{
+		fea::dary_heap<int> heap;
+		std::vector<int> values(200);
+		std::iota(values.begin(), values.end(), 0);
+		std::shuffle(values.begin(), values.end(), std::mt19937{ 42 });
+		for (int v : values) {
+			heap.push(v);
+		}
+		EXPECT_EQ(heap.size(), 200u);
+
+		for (int i = 0; i < 200; ++i) {
+			EXPECT_EQ(heap.top(), i);
+			heap.pop();
+		}
+		EXPECT_TRUE(heap.empty());
+	}
+
+	std::vector<double> points(500);
+	std::mt19937 gen{ 42 };
+	std::uniform_real_distribution<double> dist{ 0.0, 1000.0 };
+	for (double& p : points) {
+		p = dist(gen);
+	}
+	std::sort(points.begin(), points.end());
+
+	using tree_t = fea::flat_tree<std::pair<double, double>>;
+	using iter_t = tree_t::const_iterator;
+	tree_t tree;
+	tree.insert_root({ points.front(), points.back() });
+	create_intervals(
+			&tree, 0, points.data(), points.data() + points.size());
+
+	const double query = 412.3;
+	const size_t k = 10;
+	auto distance = [&](iter_t it) {
+		if (query < it->first) {
+			return it->first - query;
+		}
+		if (query > it->second) {
+			return query - it->second;
+		}
+		return 0.0;
+	};
+	auto is_leaf = [](iter_t it) { return it->first == it->second; };
+
+	std::vector<double> expected = points;
+	std::sort(expected.begin(), expected.end(), [&](double lhs, double rhs) {
+		return std::abs(lhs - query) < std::abs(rhs - query);
+	});
+	expected.resize(k);
+
+	const tree_t& ctree = tree;
+
+	// Distances are lower bounds, the first k leaves are the nearest.
+	{
+		std::vector<double> found;
+		size_t visited = 0;
+		double last_dist = 0.0;
+		fea::for_each_bestfirst(ctree.root(), distance, [&](iter_t it) {
+			++visited;
+			EXPECT_LE(last_dist, distance(it));
+			last_dist = distance(it);
+
+			if (is_leaf(it)) {
+				found.push_back(it->first);
+			}
+			return found.size() < k;
+		});
+		EXPECT_EQ(found, expected);
+		EXPECT_LT(visited, tree.size());
+	}
+
+	// Without early exit, prune with the k-th best distance at pop time.
+	{
+		std::vector<double> found;
+		size_t visited = 0;
+		fea::bestfirst_heap<iter_t, double> heap;
+		auto cull_pred = [&](iter_t it) {
+			return found.size() == k
+					&& distance(it) > std::abs(found.back() - query);
+		};
+
+		for (size_t i = 0; i < 2; ++i) {
+			found.clear();
+			visited = 0;
+			fea::for_each_bestfirst(
+					ctree.root(), distance,
+					[&](iter_t it) {
+						++visited;
+						if (is_leaf(it) && found.size() < k) {
+							found.push_back(it->first);
+						}
+					},
+					cull_pred, &heap);
+			EXPECT_EQ(found, expected);
+			EXPECT_LT(visited, tree.size());
+			EXPECT_TRUE(heap.empty());
+		}
+	}
+
+	// Everything is visited without culling.
+	{
+		size_t visited = 0;
+		fea::for_each_bestfirst(
+				ctree.root(), distance, [&](iter_t) { ++visited; });
+		EXPECT_EQ(visited, tree.size());
+	}
+}
+} // namespace
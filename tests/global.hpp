@@ -152,7 +152,7 @@ inline void test_breadth(InputIt root, StatePtr* data_ptr = nullptr) {
 namespace detail {
 template <class InputIt, class StatePtr>
 inline void test_depth_flat(
-		InputIt root, StatePtr* state_ptr, std::bidirectional_iterator_tag) {
+		InputIt root, StatePtr* state_ptr, std::forward_iterator_tag) {
 	const InputIt croot = root;
 
 	// non-const
@@ -165,6 +165,16 @@ inline void test_depth_flat(
 
 		EXPECT_EQ(depth_graph.size(), recursed_depth_graph.size());
 		EXPECT_EQ(depth_graph, recursed_depth_graph);
+
+		// Shallow limits defer most of the tree to the stack.
+		for (size_t max_recursion : { 0u, 1u, 2u, 16u }) {
+			std::vector<InputIt> hybrid_depth_graph;
+			fea::for_each_depthfirst_hybrid(
+					root,
+					[&](InputIt it) { hybrid_depth_graph.push_back(it); },
+					state_ptr, max_recursion);
+			EXPECT_EQ(hybrid_depth_graph, recursed_depth_graph);
+		}
 	}
 
 	// const
@@ -223,7 +233,7 @@ namespace detail {
 template <class InputIt, class CullPred, class ParentCullPred, class StatePtr>
 inline void test_culling_flat_depth(InputIt root, CullPred cull_pred,
 		ParentCullPred p_cull_pred, StatePtr* state_ptr,
-		std::bidirectional_iterator_tag) {
+		std::forward_iterator_tag) {
 	std::vector<InputIt> depth_graph;
 	fea::gather_depthfirst_flat(root, cull_pred, &depth_graph, state_ptr);
 
@@ -233,6 +243,14 @@ inline void test_culling_flat_depth(InputIt root, CullPred cull_pred,
 		EXPECT_FALSE(p);
 		EXPECT_FALSE(pp);
 	}
+
+	for (size_t max_recursion : { 0u, 1u, 2u, 16u }) {
+		std::vector<InputIt> hybrid_depth_graph;
+		fea::for_each_depthfirst_hybrid(
+				root, [&](InputIt it) { hybrid_depth_graph.push_back(it); },
+				cull_pred, state_ptr, max_recursion);
+		EXPECT_EQ(hybrid_depth_graph, depth_graph);
+	}
 }
 template <class InputIt, class CullPred, class ParentCullPred, class StatePtr>
 inline void test_culling_flat_depth(
@@ -329,3 +347,72 @@ inline void test_culling(InputIt root, CullPred cull_pred,
 				typename std::iterator_traits<InputIt>::iterator_category{});
 	}
 }
+
+namespace detail {
+template <class FwdIt, class CullPred, class StatePtr>
+inline void gather_postorder(FwdIt node, CullPred cull_pred,
+		std::vector<FwdIt>* out, StatePtr* state_ptr) {
+	if (cull_pred(node)) {
+		return;
+	}
+
+	using fea::children_range;
+	auto range = children_range(node, state_ptr);
+	for (auto it = range.first; it != range.second; ++it) {
+		gather_postorder(it, cull_pred, out, state_ptr);
+	}
+	out->push_back(node);
+}
+} // namespace detail
+
+// Compares the stackless traversals with recursed ones.
+// Requires a parent_node specialization.
+template <class FwdIt, class CullPred, class StatePtr = const void>
+inline void test_stackless(
+		FwdIt root, CullPred cull_pred, StatePtr* state_ptr = nullptr) {
+	// pre-order
+	{
+		std::vector<FwdIt> stackless_graph;
+		fea::for_each_depthfirst_stackless(
+				root, [&](FwdIt node) { stackless_graph.push_back(node); },
+				cull_pred, state_ptr);
+
+		std::vector<FwdIt> recursed_depth_graph;
+		fea::gather_depthfirst(
+				root, &recursed_depth_graph, cull_pred, state_ptr);
+
+		EXPECT_EQ(stackless_graph.size(), recursed_depth_graph.size());
+		EXPECT_EQ(stackless_graph, recursed_depth_graph);
+
+		stackless_graph.clear();
+		fea::for_each_depthfirst_stackless(
+				root, [&](FwdIt node) { stackless_graph.push_back(node); },
+				state_ptr);
+		fea::gather_depthfirst(root, &recursed_depth_graph, state_ptr);
+		EXPECT_EQ(stackless_graph, recursed_depth_graph);
+	}
+
+	// post-order
+	{
+		std::vector<FwdIt> stackless_graph;
+		fea::for_each_depthfirst_postorder_stackless(
+				root, [&](FwdIt node) { stackless_graph.push_back(node); },
+				cull_pred, state_ptr);
+
+		std::vector<FwdIt> recursed_graph;
+		detail::gather_postorder(root, cull_pred, &recursed_graph, state_ptr);
+
+		EXPECT_EQ(stackless_graph.size(), recursed_graph.size());
+		EXPECT_EQ(stackless_graph, recursed_graph);
+
+		stackless_graph.clear();
+		fea::for_each_depthfirst_postorder_stackless(
+				root, [&](FwdIt node) { stackless_graph.push_back(node); },
+				state_ptr);
+
+		recursed_graph.clear();
+		detail::gather_postorder(
+				root, [](FwdIt) { return false; }, &recursed_graph, state_ptr);
+		EXPECT_EQ(stackless_graph, recursed_graph);
+	}
+}
@@ -51,6 +51,23 @@ protected:
 	T* _t = nullptr;
 };
 
+template <class T>
+struct fwd_it : public input_it<T> {
+	using iterator_category = std::forward_iterator_tag;
+
+	using input_it<T>::input_it;
+
+	fwd_it operator++() {
+		++input_it<T>::_t;
+		return *this;
+	}
+	fwd_it operator++(int) {
+		fwd_it i = *this;
+		++*this;
+		return i;
+	}
+};
+
 template <class T>
 struct bidir_it : public input_it<T> {
 	using iterator_category = std::bidirectional_iterator_tag;
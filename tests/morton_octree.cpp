@@ -0,0 +1,204 @@
+﻿#include <algorithm>
+#include <array>
+#include <fea_flat_recurse/fea_flat_recurse.hpp>
+#include <fea_flat_recurse/octree.hpp>
+#include <gtest/gtest.h>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace {
+// Clustered points, with duplicates.
+std::vector<std::array<float, 3>> make_points(size_t count) {
+	std::mt19937 gen{ 42 };
+	std::uniform_real_distribution<float> uniform{ -100.f, 100.f };
+	std::normal_distribution<float> cluster{ 0.f, 2.f };
+
+	std::vector<std::array<float, 3>> ret;
+	ret.reserve(count);
+	for (size_t i = 0; i < count; ++i) {
+		if (i % 4 == 0) {
+			ret.push_back({ uniform(gen), uniform(gen), uniform(gen) });
+		} else if (i % 50 == 1) {
+			ret.push_back(ret.back());
+		} else {
+			ret.push_back({ 30.f + cluster(gen), -10.f + cluster(gen),
+					5.f + cluster(gen) });
+		}
+	}
+	return ret;
+}
+
+void test_octree(const fea::octree& tree,
+		const std::vector<std::array<float, 3>>& points,
+		uint32_t max_leaf_size) {
+	ASSERT_FALSE(tree.empty());
+	EXPECT_TRUE(std::is_sorted(tree.codes().begin(), tree.codes().end()));
+
+	std::vector<uint32_t> indices = tree.point_indices();
+	std::sort(indices.begin(), indices.end());
+	std::vector<uint32_t> ref(points.size());
+	std::iota(ref.begin(), ref.end(), 0u);
+	EXPECT_EQ(indices, ref);
+
+	// Every node is reached, leaves cover the points in order.
+	std::vector<fea::octree::const_iterator> nodes;
+	fea::gather_depthfirst_flat(tree.root(), &nodes);
+	EXPECT_EQ(nodes.size(), tree.size());
+
+	uint32_t next_point = 0;
+	for (fea::octree::const_iterator it : nodes) {
+		const fea::octree_node& n = *it;
+		EXPECT_LT(n.first_point, n.last_point);
+
+		if (n.num_children == 0) {
+			EXPECT_EQ(n.first_point, next_point);
+			next_point = n.last_point;
+			EXPECT_TRUE(n.last_point - n.first_point <= max_leaf_size
+					|| n.level == fea::morton_max_level);
+			continue;
+		}
+
+		// Children split their parent in octants.
+		uint32_t first = n.first_point;
+		uint32_t prev_octant = 0;
+		for (uint32_t c = 0; c < n.num_children; ++c) {
+			const fea::octree_node& child = tree[n.first_child + c];
+			EXPECT_EQ(child.level, n.level + 1);
+			EXPECT_EQ(child.first_point, first);
+			first = child.last_point;
+
+			uint32_t octant = fea::morton_octant(
+					tree.codes()[child.first_point], child.level);
+			if (c != 0) {
+				EXPECT_LT(prev_octant, octant);
+			}
+			prev_octant = octant;
+		}
+		EXPECT_EQ(first, n.last_point);
+	}
+	EXPECT_EQ(next_point, points.size());
+
+	// Points are inside their leaf.
+	for (fea::octree::const_iterator it : nodes) {
+		const fea::octree_node& n = *it;
+		if (n.num_children != 0) {
+			continue;
+		}
+
+		std::array<float, 3> min;
+		float size = 0.f;
+		tree.bounds(it.index(), &min, &size);
+		const float eps = 1e-3f;
+		for (uint32_t i = n.first_point; i < n.last_point; ++i) {
+			const std::array<float, 3>& p
+					= points[tree.point_indices()[i]];
+			for (size_t a = 0; a < 3; ++a) {
+				EXPECT_GE(p[a], min[a] - eps);
+				EXPECT_LE(p[a], min[a] + size + eps);
+			}
+		}
+	}
+}
+
+TEST(flat_recurse, octree_build) {
+	std::vector<std::array<float, 3>> points = make_points(20'000);
+
+	fea::octree ref;
+	fea::inline_executor inline_exec;
+	fea::build_octree(inline_exec, points.begin(), points.end(), &ref);
+	test_octree(ref, points, 1);
+
+	auto equal_trees = [](const fea::octree& lhs, const fea::octree& rhs) {
+		if (lhs.size() != rhs.size() || lhs.codes() != rhs.codes()
+				|| lhs.point_indices() != rhs.point_indices()) {
+			return false;
+		}
+		for (uint32_t i = 0; i < lhs.size(); ++i) {
+			const fea::octree_node& l = lhs[i];
+			const fea::octree_node& r = rhs[i];
+			if (l.first_point != r.first_point || l.last_point != r.last_point
+					|| l.first_child != r.first_child
+					|| l.num_children != r.num_children
+					|| l.level != r.level) {
+				return false;
+			}
+		}
+		return true;
+	};
+
+	// Parallel builds match, rebuilds reuse the tree.
+	fea::octree tree;
+	fea::work_stealing_pool pool{ 4 };
+	for (size_t i = 0; i < 2; ++i) {
+		fea::build_octree(pool, points.begin(), points.end(), &tree);
+		EXPECT_TRUE(equal_trees(tree, ref));
+	}
+
+	fea::build_octree(points.data(), points.data() + points.size(), &tree);
+	EXPECT_TRUE(equal_trees(tree, ref));
+
+	// Bigger leaves.
+	fea::build_octree(pool, points.begin(), points.end(), &tree, 16);
+	test_octree(tree, points, 16);
+	EXPECT_LT(tree.size(), ref.size());
+
+	// Single point and empty.
+	fea::build_octree(pool, points.begin(), points.begin() + 1, &tree);
+	EXPECT_EQ(tree.size(), 1u);
+	fea::build_octree(pool, points.begin(), points.begin(), &tree);
+	EXPECT_TRUE(tree.empty());
+}
+
+TEST(flat_recurse, morton_octree) {
+	std::vector<std::array<float, 3>> points = make_points(20'000);
+
+	fea::octree ref;
+	fea::inline_executor inline_exec;
+	fea::build_octree(inline_exec, points.begin(), points.end(), &ref);
+	const std::vector<uint64_t>& keys = ref.codes();
+	const uint64_t* first = keys.data();
+
+	fea::morton_octree_iterator root
+			= fea::make_morton_octree_root(first, first + keys.size());
+
+	// Same nodes as an octree with single point leaves.
+	auto equal_node
+			= [&](fea::morton_octree_iterator it, const fea::octree_node& n) {
+				  return it.key_begin() - first == n.first_point
+						  && it.key_end() - first == n.last_point
+						  && it.level() == n.level
+						  && it.is_leaf() == (n.num_children == 0);
+			  };
+
+	std::vector<fea::morton_octree_iterator> nodes;
+	fea::gather_breadthfirst(root, &nodes);
+	ASSERT_EQ(nodes.size(), ref.size());
+	for (uint32_t i = 0; i < nodes.size(); ++i) {
+		EXPECT_TRUE(equal_node(nodes[i], ref[i]));
+	}
+
+	std::vector<fea::octree::const_iterator> ref_nodes;
+	fea::gather_depthfirst_flat(ref.root(), &ref_nodes);
+	fea::gather_depthfirst_flat(root, &nodes);
+	ASSERT_EQ(nodes.size(), ref_nodes.size());
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		EXPECT_TRUE(equal_node(nodes[i], *ref_nodes[i]));
+	}
+
+	// Prefixes are the minimum corner of the node.
+	for (fea::morton_octree_iterator it : nodes) {
+		uint32_t shift = 3 * (fea::morton_max_level - it.level());
+		for (const uint64_t* k = it.key_begin(); k != it.key_end(); ++k) {
+			EXPECT_EQ(it.prefix(), (*k >> shift) << shift);
+		}
+	}
+
+	// Single key.
+	nodes.clear();
+	fea::gather_depthfirst_flat(
+			fea::make_morton_octree_root(first, first + 1), &nodes);
+	ASSERT_EQ(nodes.size(), 1u);
+	EXPECT_TRUE(nodes.front().is_leaf());
+}
+} // namespace
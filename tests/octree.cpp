@@ -26,9 +26,46 @@ struct octree_node {
 	using citer = typename std::array<size_t, 8>::const_iterator;
 	using iter = typename std::array<size_t, 8>::iterator;
 };
+
+// Index apis customization point, found through ADL.
+std::pair<octree_node::citer, octree_node::citer> children_indices(
+		uint32_t idx, const std::vector<octree_node>* tree) {
+	const octree_node& n = (*tree)[idx];
+	return { n.children.begin(), n.children.end() };
+}
+
+// Mostly empty octree, with an occupancy mask.
+struct sparse_octree_node {
+	std::array<uint32_t, 8> children{
+		std::numeric_limits<uint32_t>::max(),
+		std::numeric_limits<uint32_t>::max(),
+		std::numeric_limits<uint32_t>::max(),
+		std::numeric_limits<uint32_t>::max(),
+		std::numeric_limits<uint32_t>::max(),
+		std::numeric_limits<uint32_t>::max(),
+		std::numeric_limits<uint32_t>::max(),
+		std::numeric_limits<uint32_t>::max(),
+	};
+	uint8_t occupancy = 0;
+};
+
+using sparse_octree_it = fea::sparse_slot_iterator<const uint32_t*, uint8_t>;
+
+std::pair<std::array<uint32_t, 8>::const_iterator,
+		std::array<uint32_t, 8>::const_iterator>
+children_indices(uint32_t idx, const std::vector<sparse_octree_node>* tree) {
+	const sparse_octree_node& n = (*tree)[idx];
+	return { n.children.begin(), n.children.end() };
+}
 } // namespace
 
 namespace fea {
+// Children ranges are empty or hold 8 slots, unroll them.
+template <>
+struct children_arity<octree_node::iter> : fixed_arity<8> {};
+template <>
+struct children_arity<octree_node::citer> : fixed_arity<8> {};
+
 template <>
 std::pair<octree_node::iter, octree_node::iter> children_range(
 		octree_node::iter parent, std::vector<octree_node>* tree) {
@@ -54,6 +91,13 @@ std::pair<octree_node::citer, octree_node::citer> children_range(
 	const octree_node& n = (*tree)[parent_idx];
 	return { n.children.begin(), n.children.end() };
 }
+
+template <>
+std::pair<sparse_octree_it, sparse_octree_it> children_range(
+		sparse_octree_it parent, const std::vector<sparse_octree_node>* tree) {
+	const sparse_octree_node& n = (*tree)[*parent];
+	return fea::make_sparse_slots_range(n.children.data(), n.occupancy);
+}
 } // namespace fea
 
 namespace {
@@ -171,5 +215,148 @@ TEST(flat_recurse, octree) {
 		test_culling(
 				const_root_it, cull_pred, parent_cull_pred, const_tree_ptr);
 	}
+
+	// indices
+	{
+		auto cull_invalid = [&](octree_node::citer idx_it) {
+			return *idx_it == std::numeric_limits<size_t>::max();
+		};
+		auto cull_odd = [&](octree_node::citer idx_it) {
+			return cull_invalid(idx_it) || (*idx_it % 2) == 1;
+		};
+		auto to_indices = [](const std::vector<octree_node::citer>& its) {
+			std::vector<uint32_t> ret;
+			for (octree_node::citer it : its) {
+				ret.push_back(uint32_t(*it));
+			}
+			return ret;
+		};
+
+		std::vector<octree_node::citer> ref;
+		std::vector<uint32_t> out;
+
+		SCOPED_TRACE("octree test indices depth");
+		fea::gather_depthfirst_flat(
+				const_root_it, cull_invalid, &ref, const_tree_ptr);
+		fea::gather_depthfirst_indices(0, &out, const_tree_ptr);
+		EXPECT_EQ(out.size(), tree.size());
+		EXPECT_EQ(out, to_indices(ref));
+
+		fea::gather_depthfirst_flat(
+				const_root_it, cull_odd, &ref, const_tree_ptr);
+		fea::gather_depthfirst_indices(
+				0, [](uint32_t idx) { return (idx % 2) == 1; }, &out,
+				const_tree_ptr);
+		EXPECT_EQ(out, to_indices(ref));
+
+		SCOPED_TRACE("octree test indices breadth");
+		fea::gather_breadthfirst(
+				const_root_it, cull_invalid, &ref, const_tree_ptr);
+		fea::gather_breadthfirst_indices(0, &out, const_tree_ptr);
+		EXPECT_EQ(out.size(), tree.size());
+		EXPECT_EQ(out, to_indices(ref));
+
+		fea::gather_breadthfirst(
+				const_root_it, cull_odd, &ref, const_tree_ptr);
+		fea::gather_breadthfirst_indices(
+				0, [](uint32_t idx) { return (idx % 2) == 1; }, &out,
+				const_tree_ptr);
+		EXPECT_EQ(out, to_indices(ref));
+
+		SCOPED_TRACE("octree test indices staged breadth");
+		std::vector<std::vector<uint32_t>> staged_out;
+		fea::gather_breadthfirst_staged_indices(
+				0, &staged_out, const_tree_ptr);
+
+		fea::gather_breadthfirst(
+				const_root_it, cull_invalid, &ref, const_tree_ptr);
+		out.clear();
+		for (const std::vector<uint32_t>& v : staged_out) {
+			out.insert(out.end(), v.begin(), v.end());
+		}
+		EXPECT_EQ(out, to_indices(ref));
+	}
+}
+
+TEST(flat_recurse, octree_sparse_slots) {
+	// Occupy roughly a quarter of the slots, down to a fixed depth.
+	std::vector<sparse_octree_node> tree(1);
+	std::vector<uint32_t> breadth{ 0 };
+	for (size_t depth = 0; depth < 6; ++depth) {
+		std::vector<uint32_t> next_breadth;
+		for (uint32_t idx : breadth) {
+			for (uint32_t j = 0; j < 8; ++j) {
+				if ((idx * 7 + j * 3) % 4 != 0 && !(idx == 0 && j == 1)) {
+					continue;
+				}
+
+				uint32_t child_idx = uint32_t(tree.size());
+				tree.push_back({});
+				tree[idx].children[j] = child_idx;
+				tree[idx].occupancy |= uint8_t(1u << j);
+				next_breadth.push_back(child_idx);
+			}
+		}
+		breadth.swap(next_breadth);
+	}
+	ASSERT_GT(tree.size(), 100u);
+
+	const std::vector<sparse_octree_node>* tree_ptr = &tree;
+	uint32_t root_idx = 0;
+	sparse_octree_it root
+			= fea::make_sparse_slot_root<const uint32_t*, uint8_t>(&root_idx);
+
+	auto to_indices = [](const std::vector<sparse_octree_it>& its) {
+		std::vector<uint32_t> ret;
+		for (sparse_octree_it it : its) {
+			ret.push_back(*it);
+		}
+		return ret;
+	};
+
+	// Empty slots are never visited or culled.
+	auto cull_odd = [](sparse_octree_it it) {
+		EXPECT_NE(*it, std::numeric_limits<uint32_t>::max());
+		return (*it % 2) == 1;
+	};
+	auto cull_odd_idx = [](uint32_t idx) { return (idx % 2) == 1; };
+
+	std::vector<uint32_t> ref;
+	std::vector<sparse_octree_it> out;
+
+	fea::gather_depthfirst_indices(0, &ref, tree_ptr);
+	EXPECT_EQ(ref.size(), tree.size());
+	fea::gather_depthfirst_flat(root, &out, tree_ptr);
+	EXPECT_EQ(to_indices(out), ref);
+	fea::gather_depthfirst(root, &out, tree_ptr);
+	EXPECT_EQ(to_indices(out), ref);
+
+	fea::gather_depthfirst_indices(0, cull_odd_idx, &ref, tree_ptr);
+	fea::gather_depthfirst_flat(root, cull_odd, &out, tree_ptr);
+	EXPECT_EQ(to_indices(out), ref);
+	fea::gather_depthfirst(root, &out, cull_odd, tree_ptr);
+	EXPECT_EQ(to_indices(out), ref);
+
+	fea::gather_breadthfirst_indices(0, &ref, tree_ptr);
+	fea::gather_breadthfirst(root, &out, tree_ptr);
+	EXPECT_EQ(to_indices(out), ref);
+
+	fea::gather_breadthfirst_indices(0, cull_odd_idx, &ref, tree_ptr);
+	fea::gather_breadthfirst(root, cull_odd, &out, tree_ptr);
+	EXPECT_EQ(to_indices(out), ref);
+
+	// Iterator queries.
+	std::pair<sparse_octree_it, sparse_octree_it> range
+			= fea::children_range(root, tree_ptr);
+	EXPECT_EQ(range.first.remaining(), 3u);
+	EXPECT_EQ(range.first.slot(), 0u);
+	EXPECT_EQ(range.first.slot_it(), tree[0].children.data());
+	++range.first;
+	EXPECT_EQ(range.first.slot(), 1u);
+	++range.first;
+	EXPECT_EQ(range.first.slot(), 4u);
+	EXPECT_EQ(range.first.remaining(), 1u);
+	++range.first;
+	EXPECT_EQ(range.first, range.second);
 }
 } // namespace
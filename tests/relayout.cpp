@@ -0,0 +1,118 @@
+﻿#include "global.hpp"
+#include "small_obj.hpp"
+
+#include <algorithm>
+#include <fea_flat_recurse/fea_flat_recurse.hpp>
+#include <fea_flat_recurse/relayout.hpp>
+#include <gtest/gtest.h>
+#include <utility>
+#include <vector>
+
+namespace {
+// Compares traversals of the relayout tree with traversals of the original.
+void test_relayout(
+		small_obj::iter root, fea::layout_order order, size_t num_nodes) {
+	auto tree = fea::relayout(
+			root, order, [](small_obj::iter it) -> const small_obj* {
+				return &(*it);
+			});
+	using tree_t = decltype(tree);
+
+	EXPECT_EQ(tree.size(), num_nodes);
+	EXPECT_EQ(tree.nodes.front(), &(*root));
+	EXPECT_EQ(tree.child_offsets.size(), num_nodes + 1);
+	EXPECT_EQ(tree.children.size(), num_nodes - 1);
+
+	auto to_nodes = [&](const std::vector<tree_t::iter>& its) {
+		std::vector<const small_obj*> ret;
+		for (tree_t::iter it : its) {
+			ret.push_back(tree[it]);
+		}
+		return ret;
+	};
+	auto to_ptrs = [](const std::vector<small_obj::iter>& its) {
+		std::vector<const small_obj*> ret;
+		for (small_obj::iter it : its) {
+			ret.push_back(&(*it));
+		}
+		return ret;
+	};
+
+	std::vector<small_obj::iter> ref;
+	std::vector<tree_t::iter> out;
+
+	fea::gather_depthfirst_flat(root, &ref);
+	fea::gather_depthfirst_flat(tree.root(), &out, &tree);
+	EXPECT_EQ(to_nodes(out), to_ptrs(ref));
+
+	fea::gather_breadthfirst(root, &ref);
+	fea::gather_breadthfirst(tree.root(), &out, &tree);
+	EXPECT_EQ(to_nodes(out), to_ptrs(ref));
+
+	// The layout itself.
+	if (order == fea::layout_order::depthfirst) {
+		fea::gather_depthfirst_flat(root, &ref);
+		EXPECT_EQ(tree.nodes, to_ptrs(ref));
+	} else if (order == fea::layout_order::breadthfirst) {
+		fea::gather_breadthfirst(root, &ref);
+		EXPECT_EQ(tree.nodes, to_ptrs(ref));
+	}
+
+	// Iterators survive moving the tree, and destroying the moved from tree.
+	tree_t::iter root_it = tree.root();
+	fea::gather_depthfirst_flat(root_it, &out, &tree);
+	std::vector<const small_obj*> before = to_nodes(out);
+
+	tree_t moved;
+	{
+		tree_t tmp = std::move(tree);
+		moved = std::move(tmp);
+	}
+	EXPECT_EQ(moved.root(), root_it);
+	fea::gather_depthfirst_flat(root_it, &out, &moved);
+
+	std::vector<const small_obj*> after;
+	for (tree_t::iter it : out) {
+		after.push_back(moved[it]);
+	}
+	EXPECT_EQ(after, before);
+}
+
+TEST(flat_recurse, relayout) {
+	for (fea::layout_order order :
+			{ fea::layout_order::depthfirst, fea::layout_order::breadthfirst,
+					fea::layout_order::van_emde_boas }) {
+		std::vector<small_obj> deep{ { nullptr } };
+		deep.back().create_graph(7, 3);
+		test_relayout(deep.begin(), order, 1093);
+
+		std::vector<small_obj> wide{ { nullptr } };
+		wide.back().create_graph(3, 20);
+		test_relayout(wide.begin(), order, 421);
+
+		std::vector<small_obj> leaf{ { nullptr } };
+		test_relayout(leaf.begin(), order, 1);
+	}
+}
+
+TEST(flat_recurse, relayout_van_emde_boas) {
+	// Complete binary tree, 4 high.
+	std::vector<small_obj> root{ { nullptr } };
+	root.back().create_graph(4, 2);
+
+	std::vector<small_obj::iter> bfs;
+	fea::gather_breadthfirst(root.begin(), &bfs);
+	ASSERT_EQ(bfs.size(), 15u);
+
+	auto tree = fea::relayout(root.begin(), fea::layout_order::van_emde_boas,
+			[&](small_obj::iter it) {
+				return size_t(std::find(bfs.begin(), bfs.end(), it)
+						- bfs.begin());
+			});
+
+	// Top tree, then the 4 bottom trees.
+	std::vector<size_t> expected{ 0, 1, 2, 3, 7, 8, 4, 9, 10, 5, 11, 12, 6,
+		13, 14 };
+	EXPECT_EQ(tree.nodes, expected);
+}
+} // namespace
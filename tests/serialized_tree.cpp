@@ -0,0 +1,167 @@
+﻿#include "global.hpp"
+#include "small_obj.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fea_flat_recurse/fea_flat_recurse.hpp>
+#include <fea_flat_recurse/serialized_tree.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+struct payload {
+	uint32_t id;
+	bool disabled;
+};
+
+// Checks the view traversals match the original tree's.
+void test_view(const fea::serialized_tree_view<payload>& view,
+		small_obj::iter root,
+		const std::unordered_map<const small_obj*, uint32_t>& ids) {
+	using view_iter = fea::serialized_tree_view<payload>::iterator;
+
+	auto to_ids = [](const std::vector<view_iter>& its) {
+		std::vector<uint32_t> ret;
+		for (view_iter it : its) {
+			ret.push_back(it->id);
+		}
+		return ret;
+	};
+	auto orig_to_ids = [&](const std::vector<small_obj::iter>& its) {
+		std::vector<uint32_t> ret;
+		for (small_obj::iter it : its) {
+			ret.push_back(ids.at(&(*it)));
+		}
+		return ret;
+	};
+
+	std::vector<small_obj::iter> ref;
+	std::vector<view_iter> out;
+
+	fea::gather_depthfirst(root, &ref);
+	fea::gather_depthfirst(view.root(), &out);
+	EXPECT_EQ(out.size(), view.size());
+	EXPECT_EQ(to_ids(out), orig_to_ids(ref));
+
+	fea::gather_depthfirst_flat(view.root(), &out);
+	EXPECT_EQ(to_ids(out), orig_to_ids(ref));
+
+	fea::gather_breadthfirst(root, &ref);
+	fea::gather_breadthfirst(view.root(), &out);
+	EXPECT_EQ(to_ids(out), orig_to_ids(ref));
+
+	auto cull_pred = [](small_obj::iter it) { return it->disabled; };
+	auto view_cull_pred = [](view_iter it) { return it->disabled; };
+	fea::gather_depthfirst_flat(root, cull_pred, &ref);
+	fea::gather_depthfirst_flat(view.root(), view_cull_pred, &out);
+	EXPECT_EQ(to_ids(out), orig_to_ids(ref));
+
+	std::vector<std::vector<view_iter>> staged_out;
+	fea::gather_breadthfirst_staged(view.root(), &staged_out);
+	EXPECT_EQ(staged_out.size(), 5u);
+}
+
+TEST(flat_recurse, serialized_tree) {
+	std::vector<small_obj> root_vec{ { nullptr } };
+	root_vec.back().create_graph(5, 6);
+	small_obj::iter root = root_vec.begin();
+
+	std::unordered_map<const small_obj*, uint32_t> ids;
+	fea::for_each_depthfirst(root, [&](small_obj::iter it) {
+		uint32_t id = uint32_t(ids.size());
+		ids[&(*it)] = id;
+	});
+
+	std::ostringstream oss;
+	fea::serialize_tree(
+			root,
+			[&](small_obj::iter it) {
+				return payload{ ids.at(&(*it)), it->disabled };
+			},
+			oss);
+	std::string bytes = oss.str();
+	EXPECT_EQ(bytes.size(),
+			fea::serialized_tree_records_offset
+					+ ids.size() * sizeof(fea::serialized_record<payload>));
+
+	// In memory, aligned.
+	{
+		std::vector<uint64_t> buffer(bytes.size() / sizeof(uint64_t) + 1);
+		std::memcpy(buffer.data(), bytes.data(), bytes.size());
+
+		fea::serialized_tree_view<payload> view(buffer.data(), bytes.size());
+		ASSERT_TRUE(view.valid());
+		EXPECT_TRUE(view.verify());
+		EXPECT_EQ(view.size(), ids.size());
+		test_view(view, root, ids);
+
+		// Truncated or wrong type.
+		fea::serialized_tree_view<payload> truncated(
+				buffer.data(), bytes.size() - 1);
+		EXPECT_FALSE(truncated.valid());
+		EXPECT_FALSE(truncated.verify());
+
+		fea::serialized_tree_view<uint64_t> wrong_type(
+				buffer.data(), bytes.size());
+		EXPECT_FALSE(wrong_type.valid());
+
+		// Corrupt records.
+		using record_t = fea::serialized_record<payload>;
+		auto corrupt = [&](size_t record_idx, uint32_t subtree_size,
+							   uint32_t num_children) {
+			std::vector<uint64_t> copy = buffer;
+			record_t* records = reinterpret_cast<record_t*>(
+					reinterpret_cast<char*>(copy.data())
+					+ fea::serialized_tree_records_offset);
+			records[record_idx].subtree_size = subtree_size;
+			records[record_idx].num_children = num_children;
+			fea::serialized_tree_view<payload> corrupt_view(
+					copy.data(), bytes.size());
+			// Records aren't read on construction.
+			EXPECT_TRUE(corrupt_view.valid());
+			return corrupt_view.verify();
+		};
+
+		const record_t* records = view.records();
+		uint32_t num_nodes = uint32_t(view.size());
+		uint32_t mid = num_nodes / 2;
+		EXPECT_TRUE(corrupt(
+				mid, records[mid].subtree_size, records[mid].num_children));
+		EXPECT_FALSE(corrupt(mid, 0, records[mid].num_children));
+		EXPECT_FALSE(corrupt(mid, num_nodes, records[mid].num_children));
+		EXPECT_FALSE(corrupt(
+				mid, records[mid].subtree_size + 1, records[mid].num_children));
+		EXPECT_FALSE(corrupt(
+				mid, records[mid].subtree_size, records[mid].num_children + 1));
+		EXPECT_FALSE(corrupt(0, num_nodes - 1, records[0].num_children));
+		EXPECT_FALSE(corrupt(0, num_nodes, records[0].num_children - 1));
+		EXPECT_FALSE(corrupt(num_nodes - 1, 2, 0));
+	}
+
+	// Memory mapped.
+	{
+		const char* path = "fea_flat_recurse_serialized_tree.bin";
+		{
+			std::ofstream ofs(path, std::ios::binary);
+			ofs.write(bytes.data(), std::streamsize(bytes.size()));
+		}
+
+		fea::mapped_file file;
+		ASSERT_TRUE(file.open(path));
+		EXPECT_EQ(file.size(), bytes.size());
+
+		fea::serialized_tree_view<payload> view(file.data(), file.size());
+		ASSERT_TRUE(view.valid());
+		EXPECT_TRUE(view.verify());
+		test_view(view, root, ids);
+
+		file.close();
+		std::remove(path);
+		EXPECT_FALSE(file.open(path));
+	}
+}
+} // namespace
@@ -2,8 +2,10 @@
 #include "global.hpp"
 #include "iterators.hpp"
 
+#include <chrono>
 #include <fea_flat_recurse/fea_flat_recurse.hpp>
 #include <gtest/gtest.h>
+#include <unordered_map>
 
 namespace fea {
 template <>
@@ -17,6 +19,11 @@ inline std::pair<small_obj*, small_obj*> children_range(
 	return { beg, beg + parent->children.size() };
 }
 
+template <>
+inline small_obj* parent_node(small_obj* node, const void*) {
+	return node->parent;
+}
+
 template <>
 std::pair<input_it<small_obj>, input_it<small_obj>> children_range(
 		input_it<small_obj> root, const void*) {
@@ -31,6 +38,17 @@ std::pair<input_it<small_obj>, input_it<small_obj>> children_range(
 	return { beg, end };
 }
 template <>
+std::pair<fwd_it<small_obj>, fwd_it<small_obj>> children_range(
+		fwd_it<small_obj> root, const void*) {
+	if (root->children.empty()) {
+		return { nullptr, nullptr };
+	}
+
+	fwd_it<small_obj> beg = { &root->children.front() };
+	fwd_it<small_obj> end = { &root->children.front() + root->children.size() };
+	return { beg, end };
+}
+template <>
 std::pair<bidir_it<small_obj>, bidir_it<small_obj>> children_range(
 		bidir_it<small_obj> root, const void*) {
 	if (root->children.empty()) {
@@ -170,6 +188,480 @@ TEST(flat_recurse, small_obj_wider) {
 	}
 }
 
+TEST(flat_recurse, small_obj_stackless) {
+	small_obj deep_root{ nullptr };
+	deep_root.create_graph(7, 7);
+
+	small_obj wide_root{ nullptr };
+	wide_root.create_graph(2, 50);
+
+	small_obj leaf_root{ nullptr };
+
+	for (small_obj* root : { &deep_root, &wide_root, &leaf_root }) {
+		// cull disabled
+		{
+			auto cull_pred = [](small_obj* node) { return node->disabled; };
+
+			root->disabled = false;
+			SCOPED_TRACE("small_obj test stackless cull disabled");
+			test_stackless(root, cull_pred);
+		}
+
+		// cull enabled
+		{
+			auto cull_pred
+					= [](small_obj* node) { return node->disabled == false; };
+
+			root->disabled = true;
+			SCOPED_TRACE("small_obj test stackless cull enabled");
+			test_stackless(root, cull_pred);
+		}
+	}
+}
+
+TEST(flat_recurse, small_obj_path) {
+	small_obj root{ nullptr };
+	root.create_graph(7, 7);
+
+	auto cull_pred = [](small_obj* node) { return node->disabled; };
+
+	std::vector<small_obj*> ref;
+	fea::gather_depthfirst(&root, &ref);
+	std::vector<small_obj*> culled_ref;
+	fea::gather_depthfirst(&root, &culled_ref, cull_pred);
+
+	// The path must match the parent chain.
+	auto check_path = [&](const std::vector<small_obj*>& path) {
+		small_obj* node = path.back();
+		for (size_t i = path.size(); i-- > 0;) {
+			EXPECT_EQ(path[i], node);
+			node = node->parent;
+		}
+		EXPECT_EQ(path.front(), &root);
+	};
+
+	std::vector<small_obj*> out;
+	fea::for_each_depthfirst_path(
+			&root, [&](const std::vector<small_obj*>& path) {
+				check_path(path);
+				out.push_back(path.back());
+			});
+	EXPECT_EQ(out, ref);
+
+	out.clear();
+	fea::for_each_depthfirst_path(
+			&root,
+			[&](const std::vector<small_obj*>& path) {
+				check_path(path);
+				out.push_back(path.back());
+			},
+			[&](const std::vector<small_obj*>& path) {
+				return cull_pred(path.back());
+			});
+	EXPECT_EQ(out, culled_ref);
+
+	small_obj leaf_root{ nullptr };
+	out.clear();
+	fea::for_each_depthfirst_path(
+			&leaf_root, [&](const std::vector<small_obj*>& path) {
+				EXPECT_EQ(path.size(), 1u);
+				out.push_back(path.back());
+			});
+	EXPECT_EQ(out, std::vector<small_obj*>{ &leaf_root });
+}
+
+TEST(flat_recurse, small_obj_resumable) {
+	small_obj root{ nullptr };
+	root.create_graph(7, 7);
+
+	auto cull_pred = [](small_obj* node) { return node->disabled; };
+
+	std::vector<small_obj*> ref;
+	fea::gather_depthfirst(&root, &ref);
+	std::vector<small_obj*> culled_ref;
+	fea::gather_depthfirst(&root, &culled_ref, cull_pred);
+
+	for (size_t step_size : { 1, 2, 7, 100, 1000000 }) {
+		std::vector<small_obj*> out;
+		auto traversal = fea::make_resumable_depthfirst(
+				&root, [&](small_obj* node) { out.push_back(node); });
+
+		size_t num_steps = 0;
+		while (!traversal.step(step_size)) {
+			EXPECT_EQ(out.size(), (num_steps + 1) * step_size);
+			++num_steps;
+		}
+		EXPECT_TRUE(traversal.done());
+		EXPECT_EQ(out, ref);
+
+		// Already done, nothing to do.
+		EXPECT_TRUE(traversal.step(step_size));
+		EXPECT_EQ(out.size(), ref.size());
+
+		out.clear();
+		traversal.reset(&root);
+		EXPECT_FALSE(traversal.done());
+		while (!traversal.step(step_size)) {
+		}
+		EXPECT_EQ(out, ref);
+
+		out.clear();
+		auto culled_traversal = fea::make_resumable_depthfirst(
+				&root, [&](small_obj* node) { out.push_back(node); },
+				cull_pred);
+		while (!culled_traversal.step(step_size)) {
+		}
+		EXPECT_EQ(out, culled_ref);
+	}
+
+	// Time sliced.
+	{
+		std::vector<small_obj*> out;
+		auto traversal = fea::make_resumable_depthfirst(
+				&root, [&](small_obj* node) { out.push_back(node); });
+
+		while (!traversal.run_for(std::chrono::microseconds(50))) {
+		}
+		EXPECT_EQ(out, ref);
+
+		out.clear();
+		traversal.reset(&root);
+		EXPECT_TRUE(traversal.run_for(std::chrono::hours(1)));
+		EXPECT_EQ(out, ref);
+	}
+}
+
+TEST(flat_recurse, small_obj_find) {
+	small_obj root{ nullptr };
+	root.create_graph(7, 7);
+
+	auto cull_pred = [](small_obj* node) { return node->disabled; };
+
+	std::vector<small_obj*> ref;
+	fea::gather_depthfirst(&root, &ref);
+	std::vector<small_obj*> culled_ref;
+	fea::gather_depthfirst(&root, &culled_ref, cull_pred);
+	std::vector<small_obj*> breadth_ref;
+	fea::gather_breadthfirst(&root, &breadth_ref);
+	std::vector<small_obj*> culled_breadth_ref;
+	fea::gather_breadthfirst(&root, cull_pred, &culled_breadth_ref);
+
+	// Visited culls mark nodes on their first test, and cull them after.
+	std::unordered_map<small_obj*, size_t> ids;
+	for (small_obj* node : ref) {
+		ids.insert({ node, ids.size() });
+	}
+	auto visited = fea::visited_bitset_atomic<std::function<size_t(small_obj*)>>(
+			ref.size(), [&](small_obj* node) { return ids.at(node); });
+	auto visited_cull = fea::make_visited_cull(&visited);
+
+	// Many matches, the first one in traversal order must be returned.
+	auto many_pred = [](small_obj* node) {
+		return node->children.empty() && node->parent->disabled;
+	};
+	// A single match, or none.
+	small_obj* target = nullptr;
+	auto one_pred = [&](small_obj* node) { return node == target; };
+
+	auto test_find = [&](auto pred) {
+		auto ref_it = std::find_if(ref.begin(), ref.end(), pred);
+		auto culled_ref_it
+				= std::find_if(culled_ref.begin(), culled_ref.end(), pred);
+		auto breadth_ref_it
+				= std::find_if(breadth_ref.begin(), breadth_ref.end(), pred);
+		auto culled_breadth_ref_it = std::find_if(
+				culled_breadth_ref.begin(), culled_breadth_ref.end(), pred);
+
+		small_obj* found = nullptr;
+		EXPECT_EQ(fea::find_if_depthfirst(&root, pred, &found),
+				ref_it != ref.end());
+		if (ref_it != ref.end()) {
+			EXPECT_EQ(found, *ref_it);
+		}
+		EXPECT_EQ(fea::any_of(&root, pred), ref_it != ref.end());
+
+		found = nullptr;
+		EXPECT_EQ(fea::find_if_depthfirst(&root, pred, cull_pred, &found),
+				culled_ref_it != culled_ref.end());
+		if (culled_ref_it != culled_ref.end()) {
+			EXPECT_EQ(found, *culled_ref_it);
+		}
+		EXPECT_EQ(fea::any_of(&root, pred, cull_pred),
+				culled_ref_it != culled_ref.end());
+
+		found = nullptr;
+		EXPECT_EQ(fea::find_if_breadthfirst(&root, pred, &found),
+				breadth_ref_it != breadth_ref.end());
+		if (breadth_ref_it != breadth_ref.end()) {
+			EXPECT_EQ(found, *breadth_ref_it);
+		}
+
+		// Runs on default_executor.
+		found = nullptr;
+		EXPECT_EQ(fea::find_if_depthfirst_par(&root, pred, &found),
+				ref_it != ref.end());
+		if (ref_it != ref.end()) {
+			EXPECT_EQ(found, *ref_it);
+		}
+
+		found = nullptr;
+		EXPECT_EQ(fea::find_if_breadthfirst_par(&root, pred, &found),
+				breadth_ref_it != breadth_ref.end());
+		if (breadth_ref_it != breadth_ref.end()) {
+			EXPECT_EQ(found, *breadth_ref_it);
+		}
+		EXPECT_EQ(fea::any_of_par(&root, pred, cull_pred),
+				culled_ref_it != culled_ref.end());
+
+		for (size_t num_threads : { 1, 2, 4, 0 }) {
+			fea::work_stealing_pool thread_pool{ num_threads };
+			const void* state = nullptr;
+
+			found = nullptr;
+			EXPECT_EQ(fea::find_if_depthfirst_par(
+							  thread_pool, &root, pred, &found, state, true),
+					ref_it != ref.end());
+			if (ref_it != ref.end()) {
+				EXPECT_EQ(found, *ref_it);
+			}
+
+			found = nullptr;
+			EXPECT_EQ(fea::find_if_depthfirst_par(thread_pool, &root, pred,
+							  cull_pred, &found, state, true),
+					culled_ref_it != culled_ref.end());
+			if (culled_ref_it != culled_ref.end()) {
+				EXPECT_EQ(found, *culled_ref_it);
+			}
+
+			// Unordered, any match will do.
+			found = nullptr;
+			EXPECT_EQ(fea::find_if_depthfirst_par(
+							  thread_pool, &root, pred, &found, state, false),
+					ref_it != ref.end());
+			if (ref_it != ref.end()) {
+				EXPECT_TRUE(pred(found));
+			}
+
+			EXPECT_EQ(fea::any_of_par(thread_pool, &root, pred, state),
+					ref_it != ref.end());
+			EXPECT_EQ(fea::any_of_par(
+							  thread_pool, &root, pred, cull_pred, state),
+					culled_ref_it != culled_ref.end());
+		}
+
+		fea::work_stealing_pool pool{ 3 };
+		found = nullptr;
+		EXPECT_EQ(fea::find_if_depthfirst_par(pool, &root, pred, &found),
+				ref_it != ref.end());
+		if (ref_it != ref.end()) {
+			EXPECT_EQ(found, *ref_it);
+		}
+
+		found = nullptr;
+		EXPECT_EQ(fea::find_if_depthfirst_par(
+						  pool, &root, pred, cull_pred, &found),
+				culled_ref_it != culled_ref.end());
+		if (culled_ref_it != culled_ref.end()) {
+			EXPECT_EQ(found, *culled_ref_it);
+		}
+
+		EXPECT_EQ(fea::any_of_par(pool, &root, pred), ref_it != ref.end());
+		EXPECT_EQ(fea::any_of_par(pool, &root, pred, cull_pred),
+				culled_ref_it != culled_ref.end());
+
+		found = nullptr;
+		EXPECT_EQ(fea::find_if_breadthfirst_par(pool, &root, pred, &found),
+				breadth_ref_it != breadth_ref.end());
+		if (breadth_ref_it != breadth_ref.end()) {
+			EXPECT_EQ(found, *breadth_ref_it);
+		}
+
+		found = nullptr;
+		EXPECT_EQ(fea::find_if_breadthfirst_par(
+						  pool, &root, pred, cull_pred, &found),
+				culled_breadth_ref_it != culled_breadth_ref.end());
+		if (culled_breadth_ref_it != culled_breadth_ref.end()) {
+			EXPECT_EQ(found, *culled_breadth_ref_it);
+		}
+
+		// Each node must be culled once, or visited culls cull everything.
+		// The tree has no shared nodes, results match the unculled ones.
+		visited.clear();
+		found = nullptr;
+		EXPECT_EQ(fea::find_if_depthfirst_par(
+						  pool, &root, pred, visited_cull, &found),
+				ref_it != ref.end());
+		if (ref_it != ref.end()) {
+			EXPECT_EQ(found, *ref_it);
+		}
+
+		visited.clear();
+		EXPECT_EQ(fea::any_of_par(pool, &root, pred, visited_cull),
+				ref_it != ref.end());
+
+		visited.clear();
+		found = nullptr;
+		EXPECT_EQ(fea::find_if_breadthfirst_par(
+						  pool, &root, pred, visited_cull, &found),
+				breadth_ref_it != breadth_ref.end());
+		if (breadth_ref_it != breadth_ref.end()) {
+			EXPECT_EQ(found, *breadth_ref_it);
+		}
+	};
+
+	test_find(many_pred);
+
+	for (small_obj* t : { ref.front(), ref[ref.size() / 3],
+				 ref[ref.size() / 2], ref.back(), (small_obj*)nullptr }) {
+		target = t;
+		test_find(one_pred);
+	}
+}
+
+TEST(flat_recurse, small_obj_subtree_hashes) {
+	small_obj root{ nullptr };
+	root.create_graph(5, 4);
+
+	auto node_hash = [](small_obj* node) { return node->disabled ? 1 : 0; };
+
+	fea::subtree_hashes<> previous = fea::hash_subtrees(&root, node_hash);
+
+	std::vector<small_obj*> all;
+	fea::gather_depthfirst(&root, &all);
+	EXPECT_EQ(previous.size(), all.size());
+
+	// Nothing changed, everything is culled.
+	fea::subtree_hashes<> current;
+	fea::hash_subtrees(&root, node_hash, &current);
+	std::vector<small_obj*> out;
+	fea::gather_depthfirst_flat(
+			&root, fea::make_unchanged_cull(&previous, &current), &out);
+	EXPECT_TRUE(out.empty());
+
+	// Leaves have equal content, and so equal hashes.
+	std::uint64_t leaf_hash0 = 0;
+	std::uint64_t leaf_hash1 = 1;
+	small_obj* leaf0 = &root.children[0].children[0].children[0].children[0];
+	small_obj* leaf1 = &root.children[3].children[2].children[1].children[0];
+	ASSERT_TRUE(leaf0->children.empty());
+	EXPECT_TRUE(current.find(leaf0, &leaf_hash0));
+	EXPECT_TRUE(current.find(leaf1, &leaf_hash1));
+	EXPECT_EQ(leaf_hash0, leaf_hash1);
+
+	// Edit a node, only it and its ancestors changed.
+	small_obj* edited = &root.children[2].children[1].children[3];
+	edited->disabled = !edited->disabled;
+	fea::hash_subtrees(&root, node_hash, &current);
+
+	std::vector<small_obj*> expected;
+	for (small_obj* node = edited; node != nullptr; node = node->parent) {
+		expected.insert(expected.begin(), node);
+	}
+	fea::gather_depthfirst_flat(
+			&root, fea::make_unchanged_cull(&previous, &current), &out);
+	EXPECT_EQ(out, expected);
+
+	// Combined with a cull predicate.
+	fea::gather_depthfirst_flat(&root,
+			fea::make_unchanged_cull(&previous, &current,
+					[&](small_obj* node) { return node == edited; }),
+			&out);
+	expected.pop_back();
+	EXPECT_EQ(out, expected);
+}
+
+TEST(flat_recurse, small_obj_profile) {
+	small_obj root{ nullptr };
+	root.create_graph(5, 4);
+
+	fea::tree_profile profile = fea::profile_tree(&root);
+	EXPECT_FALSE(profile.sampled);
+	EXPECT_EQ(profile.num_nodes, 341u);
+	EXPECT_EQ(profile.num_leaves, 256u);
+	EXPECT_EQ(profile.max_depth, 5u);
+	EXPECT_EQ(profile.max_width(), 256u);
+	EXPECT_EQ(profile.average_branching(), 4.0);
+	EXPECT_EQ(profile.level_widths,
+			std::vector<size_t>({ 1, 4, 16, 64, 256 }));
+	EXPECT_EQ(profile.branching_histogram,
+			std::vector<size_t>({ 256, 0, 0, 0, 85 }));
+	EXPECT_EQ(profile.recommended_traversal(),
+			fea::traversal_kind::depthfirst);
+
+	// Reserves are exact, gathers keep the capacity.
+	{
+		std::vector<small_obj*> out;
+		profile.reserve(&out);
+		size_t capacity = out.capacity();
+		fea::gather_depthfirst_flat(&root, &out);
+		EXPECT_EQ(out.size(), profile.num_nodes);
+		EXPECT_EQ(out.capacity(), capacity);
+
+		std::vector<std::vector<small_obj*>> staged;
+		profile.reserve(&staged);
+		std::vector<small_obj* const*> data;
+		for (const std::vector<small_obj*>& breadth : staged) {
+			data.push_back(breadth.data());
+		}
+		for (size_t i = 0; i < 2; ++i) {
+			fea::gather_breadthfirst_staged(&root, &staged);
+			ASSERT_EQ(staged.size(), profile.level_widths.size());
+			for (size_t j = 0; j < staged.size(); ++j) {
+				EXPECT_EQ(staged[j].size(), profile.level_widths[j]);
+				EXPECT_EQ(staged[j].data(), data[j]);
+			}
+		}
+
+		auto resumable
+				= fea::make_resumable_depthfirst(&root, [](small_obj*) {});
+		resumable.reserve(profile.max_depth);
+		EXPECT_TRUE(resumable.step(profile.num_nodes + 1));
+	}
+
+	// Culled.
+	{
+		auto cull_pred = [](small_obj* node) { return node->disabled; };
+		root.disabled = false;
+		fea::tree_profile culled = fea::profile_tree(&root, cull_pred);
+
+		std::vector<std::vector<small_obj*>> staged;
+		fea::gather_breadthfirst_staged(&root, cull_pred, &staged);
+		size_t num_nodes = 0;
+		for (size_t i = 0; i < staged.size(); ++i) {
+			EXPECT_EQ(staged[i].size(), culled.level_widths[i]);
+			num_nodes += staged[i].size();
+		}
+		EXPECT_EQ(culled.num_nodes, num_nodes);
+		EXPECT_LT(culled.num_nodes, profile.num_nodes);
+	}
+
+	// Sampling a regular tree is exact.
+	{
+		fea::tree_profile sampled = fea::profile_tree_sampled(&root, 2);
+		EXPECT_TRUE(sampled.sampled);
+		EXPECT_EQ(sampled.num_nodes, profile.num_nodes);
+		EXPECT_EQ(sampled.num_leaves, profile.num_leaves);
+		EXPECT_EQ(sampled.level_widths, profile.level_widths);
+		EXPECT_EQ(sampled.branching_histogram, profile.branching_histogram);
+	}
+
+	// Wide levels.
+	{
+		small_obj wide{ nullptr };
+		wide.create_graph(3, 64);
+		EXPECT_EQ(fea::profile_tree(&wide).recommended_traversal(),
+				fea::traversal_kind::breadthfirst_staged);
+	}
+
+	// Shallow and bushy.
+	{
+		small_obj bushy{ nullptr };
+		bushy.create_graph(2, 32);
+		EXPECT_EQ(fea::profile_tree(&bushy).recommended_traversal(),
+				fea::traversal_kind::breadthfirst);
+	}
+}
+
 TEST(flat_recurse, small_obj_input_it) {
 	small_obj root{ nullptr };
 	root.create_graph(6, 10);
@@ -213,6 +705,49 @@ TEST(flat_recurse, small_obj_input_it) {
 	}
 }
 
+TEST(flat_recurse, small_obj_fwd_it) {
+	small_obj root{ nullptr };
+	root.create_graph(6, 10);
+
+	fwd_it<small_obj> root_it{ &root };
+
+	SCOPED_TRACE("small_obj fwd_it test breadth");
+	test_breadth(root_it);
+
+	SCOPED_TRACE("small_obj fwd_it test depth");
+	test_depth(root_it);
+
+	// cull disabled
+	{
+		auto cull_pred = [](auto node) { return node->disabled; };
+		auto parent_cull_pred = [=](auto node) {
+			if (node->parent == nullptr) {
+				return cull_pred(node);
+			}
+			return cull_pred(node->parent);
+		};
+
+		root.disabled = false;
+		SCOPED_TRACE("small_obj test cull disabled");
+		test_culling(root_it, cull_pred, parent_cull_pred);
+	}
+
+	// cull enabled
+	{
+		auto cull_pred = [](auto node) { return node->disabled == false; };
+		auto parent_cull_pred = [=](auto node) {
+			if (node->parent == nullptr) {
+				return cull_pred(node);
+			}
+			return cull_pred(node->parent);
+		};
+
+		root.disabled = true;
+		SCOPED_TRACE("small_obj test cull enabled");
+		test_culling(root_it, cull_pred, parent_cull_pred);
+	}
+}
+
 TEST(flat_recurse, small_obj_bidir_it) {
 	small_obj root{ nullptr };
 	root.create_graph(6, 10);
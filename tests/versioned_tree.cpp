@@ -0,0 +1,198 @@
+﻿#include "global.hpp"
+
+#include <atomic>
+#include <fea_flat_recurse/fea_flat_recurse.hpp>
+#include <fea_flat_recurse/versioned_tree.hpp>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+namespace {
+using vtree_t = fea::versioned_tree<uint32_t>;
+using iter_t = fea::versioned_tree_iterator<uint32_t>;
+
+// Builds a tree with num_nodes nodes, every node has up to 4 children.
+// Values are the node indices.
+void build(vtree_t* tree, uint32_t num_nodes) {
+	tree->insert_root(0);
+	for (uint32_t i = 1; i < num_nodes; ++i) {
+		uint32_t idx = tree->insert((i - 1) / 4, i);
+		EXPECT_EQ(idx, i);
+	}
+}
+
+std::vector<uint32_t> gather(const vtree_t::snapshot& snap) {
+	std::vector<uint32_t> ret;
+	if (snap.empty()) {
+		return ret;
+	}
+	fea::for_each_depthfirst(snap.root(), [&](iter_t it) {
+		ret.push_back(*it);
+	});
+	return ret;
+}
+
+TEST(versioned_tree, basics) {
+	vtree_t tree;
+	vtree_t::reader reader = tree.make_reader();
+	{
+		vtree_t::snapshot snap = reader.read();
+		EXPECT_TRUE(snap.empty());
+		EXPECT_EQ(snap.size(), 0u);
+	}
+
+	build(&tree, 1000);
+	EXPECT_EQ(tree.size(), 1000u);
+
+	// Not published yet.
+	{
+		vtree_t::snapshot snap = reader.read();
+		EXPECT_TRUE(snap.empty());
+	}
+
+	tree.publish();
+	{
+		vtree_t::snapshot snap = reader.read();
+		EXPECT_EQ(snap.size(), 1000u);
+
+		SCOPED_TRACE("versioned_tree test breadth");
+		test_breadth(snap.root());
+
+		SCOPED_TRACE("versioned_tree test depth");
+		test_depth(snap.root());
+
+		auto cull_pred = [](iter_t it) { return (*it % 7) == 3; };
+		auto parent_cull_pred = [&](iter_t it) {
+			if (*it == 0) {
+				return cull_pred(it);
+			}
+			return cull_pred(iter_t{ it.version(), snap.parent(*it) });
+		};
+
+		SCOPED_TRACE("versioned_tree test cull");
+		test_culling(snap.root(), cull_pred, parent_cull_pred);
+
+		std::vector<uint32_t> visited = gather(snap);
+		EXPECT_EQ(visited.size(), 1000u);
+		EXPECT_EQ(visited[0], 0u);
+		EXPECT_EQ(visited[1], 1u);
+		EXPECT_EQ(visited[2], 5u);
+	}
+}
+
+TEST(versioned_tree, isolation) {
+	vtree_t tree;
+	build(&tree, 1000);
+	tree.publish();
+
+	vtree_t::reader reader = tree.make_reader();
+	vtree_t::snapshot snap = reader.read();
+	std::vector<uint32_t> ref = gather(snap);
+
+	// Edit, erase and insert. The snapshot doesn't change.
+	tree.edit(10) = 4242;
+	tree.erase(1);
+	uint32_t idx = tree.insert(0, 9000);
+	EXPECT_LT(idx, 1000u);
+	EXPECT_EQ(tree[idx], 9000u);
+	tree.publish();
+
+	EXPECT_EQ(gather(snap), ref);
+	EXPECT_EQ(snap.size(), 1000u);
+	EXPECT_EQ(snap[10], 10u);
+
+	// Can't reclaim while the snapshot is held.
+	EXPECT_EQ(tree.num_retired(), 1u);
+	EXPECT_EQ(tree.collect(), 0u);
+
+	snap.release();
+	EXPECT_EQ(tree.collect(), 1u);
+	EXPECT_EQ(tree.num_retired(), 0u);
+
+	// The new version.
+	snap = reader.read();
+	EXPECT_EQ(snap.size(), tree.size());
+	std::vector<uint32_t> visited = gather(snap);
+	EXPECT_EQ(visited.size(), tree.size());
+	EXPECT_EQ(visited.back(), 9000u);
+	for (uint32_t v : visited) {
+		EXPECT_NE(v, 1u);
+		EXPECT_NE(v, 5u);
+		EXPECT_NE(v, 10u);
+	}
+
+	// Erase everything, slots are reused.
+	snap.release();
+	tree.erase(0);
+	EXPECT_TRUE(tree.empty());
+	EXPECT_EQ(tree.size(), 0u);
+	uint32_t root = tree.insert_root(0);
+	EXPECT_LT(root, 1000u);
+	EXPECT_LT(tree.insert(root, 1), 1000u);
+	tree.publish();
+	EXPECT_EQ(tree.num_retired(), 0u);
+
+	snap = reader.read();
+	EXPECT_EQ(gather(snap).size(), 2u);
+}
+
+TEST(versioned_tree, concurrent) {
+	constexpr uint32_t num_versions = 200;
+	constexpr size_t num_readers = 4;
+
+	// Every version is a chain of n nodes, which all store n.
+	// Readers check they never see a mix of versions.
+	vtree_t tree;
+	tree.insert_root(1);
+	tree.publish();
+
+	std::atomic<bool> done{ false };
+	std::atomic<size_t> num_errors{ 0 };
+	std::atomic<size_t> num_reads{ 0 };
+
+	std::vector<vtree_t::reader> readers;
+	for (size_t i = 0; i < num_readers; ++i) {
+		readers.push_back(tree.make_reader());
+	}
+
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < num_readers; ++i) {
+		threads.emplace_back([&, i]() {
+			do {
+				vtree_t::snapshot snap = readers[i].read();
+				uint32_t n = *snap.root();
+				size_t count = 0;
+				fea::for_each_depthfirst(snap.root(), [&](iter_t it) {
+					num_errors += *it != n;
+					++count;
+				});
+				num_errors += count != n || snap.size() != n;
+				++num_reads;
+			} while (!done.load());
+		});
+	}
+
+	uint32_t last = 0;
+	for (uint32_t n = 2; n <= num_versions; ++n) {
+		for (uint32_t idx = 0; idx < n - 1; ++idx) {
+			tree.edit(idx) = n;
+		}
+		last = tree.insert(n - 2, n);
+		tree.publish();
+	}
+	EXPECT_EQ(last, num_versions - 1);
+
+	done = true;
+	for (std::thread& t : threads) {
+		t.join();
+	}
+
+	EXPECT_EQ(num_errors.load(), 0u);
+	EXPECT_GT(num_reads.load(), 0u);
+
+	// Every snapshot is released.
+	readers.clear();
+	tree.collect();
+	EXPECT_EQ(tree.num_retired(), 0u);
+}
+} // namespace